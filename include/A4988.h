@@ -7,18 +7,10 @@
 #ifndef A4988_H
 #define A4988_H
 
-#define DIR PB4
-#define STEP PB3
-#define SLEEP PB2 // active low
-#define RESET PB1 // active low
-#define MS3 PB0
+#include "driver.h"
+#include "pins.h"
 
-#define ENABLE PD5 // active low
-#define MS1 PD6
-#define MS2 PD7
-
-#define SW_NEG PD2
-#define SW_POS PD4
+#define POSITION_SCALE DRIVER_MICROSTEPS_MAX	// position counter resolution in counts per full step (finest microstepping)
 
 
 #ifdef __cplusplus
@@ -42,7 +34,8 @@ typedef enum run_mode{
     HOME_RUN_POS = 1,
     HOME_RUN_NEG = 2,
     RETURN_FROM_NEG = 3,
-	RETURN_FROM_POS = 4
+	RETURN_FROM_POS = 4,
+	TRAJECTORY = 5
 } run_mode_t;
 
 typedef enum motor_direction{
@@ -55,9 +48,32 @@ typedef enum microstep{
 	HALF = 2,
 	QUARTER = 4,
 	EIGHTH = 8,
-	SIXTEENTH = 16
+	SIXTEENTH = 16,
+	THIRTYSECOND = 32,
+	SIXTYFOURTH = 64
 } microstep_t;
 
+typedef enum motion_result{
+	MOTION_OK = 0,
+	MOTION_BUSY = 1,
+	MOTION_LIMIT_SWITCH = 2,
+	MOTION_BELOW_SOFTLIMIT = 3,
+	MOTION_ABOVE_SOFTLIMIT = 4,
+	MOTION_BUFFER_FULL = 5,
+	MOTION_INVALID = 6
+} motion_result_t;
+
+/*
+ * A move prepared by plan_move_cnt() to be started with start_plan().
+ */
+typedef struct move_plan{
+	int32_t start;			// position the plan was made at
+	uint32_t steps;			// in the current microstepping mode
+	uint32_t accelerate;	// steps of the acceleration ramp
+	uint32_t decelerate;	// steps of the deceleration ramp
+	motor_direction_t direction;
+} move_plan_t;
+
 extern volatile motor_state_t STATE;
 extern volatile microstep_t MICROSTEPS;
 
@@ -87,6 +103,10 @@ void halt();
 void calculate_steps(uint32_t steps);
 
 
+/**
+ * Set the microstep mode of the driver, modes the driver does not
+ * support are ignored.
+ */
 void set_microstepping(microstep_t stepping);
 
 
@@ -95,25 +115,100 @@ void update_state();
 
 
 /* Interface functions */
-/**
- * Move the motor to a new position relative to its current one. The
- * distance to move is passed in units of full steps. The Motor will
- * execute the movement with the precision of its microstepping mode.
- */
-void move_relative(float distance);
-
 /*
 void home_run_pos();
 
 void home_run_neg();
 */
 
+/**
+ * Move the motor relative to its current position. The distance is
+ * passed in position counts (1/POSITION_SCALE full steps) and is
+ * truncated to the current microstepping mode. This is the motion
+ * entry point shared by all command interfaces, the move is refused if
+ * the motor is busy, a limit switch blocks the direction or the target
+ * lies outside the softlimits.
+ */
+motion_result_t move_relative_cnt(int32_t distance);
+
+/**
+ * Move the motor to target, in position counts. Same checks as
+ * move_relative_cnt(), except that the target has to lie within the
+ * softlimits even for a move back from beyond one.
+ */
+motion_result_t move_absolute_cnt(int32_t target);
+
+/**
+ * Move like move_relative_cnt(), but shortened to end at the softlimit
+ * instead of being refused, as needed for home runs. Without room left
+ * towards the softlimit nothing is done.
+ */
+motion_result_t move_clamped_cnt(int32_t distance);
+
 /**
  * Stop the current motor movement without exceeding the configured 
- * deceleration. 
+ * deceleration. A trajectory brakes from its current velocity, see
+ * follow_brake().
  */
 void soft_stop();
 
+/**
+ * Prepare a move to target, in position counts, so that it can be
+ * started from an interrupt. The ramp is calculated and DIR is set
+ * already. Refused if the motor is busy or target lies outside the
+ * softlimits, the limit switches are checked by start_plan().
+ */
+motion_result_t plan_move_cnt(int32_t target, move_plan_t* plan);
+
+/**
+ * Start a planned move with its first step at once. Call from an ISR
+ * or with interrupts disabled. Refused with MOTION_INVALID if the
+ * position changed since planning. A plan of zero steps returns
+ * MOTION_OK without moving. Speed and ramps are the ones at planning
+ * time.
+ */
+motion_result_t start_plan(const move_plan_t* plan);
+
+/**
+ * Trajectory following for pvt.c. follow_start() switches the step ISR
+ * from the ramp generator to stepping towards a target position with
+ * Timer1 at F_CPU/64. Refused if the motor is busy or both limit
+ * switches are active.
+ */
+motion_result_t follow_start();
+
+/**
+ * Set the position to reach within the next Timer2 tick, in position
+ * counts. Steps are spread evenly over the tick. The target is held at
+ * the softlimits and at an active limit switch. Called from the Timer2
+ * ISR, ignored while braking.
+ */
+void follow_target(int32_t target);
+
+/**
+ * Returns 1 from soft_stop() during a trajectory until the motor has
+ * stopped. The tick then calls follow_brake() instead of
+ * follow_target().
+ */
+uint8_t follow_braking();
+
+/**
+ * Advance the braking ramp by one tick. It starts at the velocity of
+ * the last follow_target() and slows down at the configured
+ * deceleration, the motor is halted once the velocity reached 0.
+ */
+void follow_brake();
+
+/**
+ * Returns 1 once the position is within one microstep of the target.
+ */
+uint8_t follow_reached();
+
+/**
+ * Halt the motor and return to the ramp generator.
+ */
+void follow_stop();
+
 void set_max_speed(uint16_t max_speed);
 
 void set_acceleration(uint16_t acceleration);
@@ -122,6 +217,24 @@ void set_deceleration(uint16_t deceleration);
 
 void set_position(float cnt);
 
+/**
+ * Set the position counter, in counts of 1/POSITION_SCALE full steps.
+ */
+void set_position_cnt(int32_t cnt);
+
+/**
+ * Softlimits in position counts, checked by move_relative_cnt() and
+ * move_absolute_cnt(). A running move is shortened to stop at a changed
+ * softlimit, the step ISR halts the motor if it still reaches one.
+ */
+void set_softlimit_pos(int32_t cnt);
+
+void set_softlimit_neg(int32_t cnt);
+
+int32_t get_softlimit_pos();
+
+int32_t get_softlimit_neg();
+
 uint16_t get_speed_limit();
 
 uint16_t get_acceleration();
@@ -133,6 +246,12 @@ uint16_t get_deceleration();
  */
 float get_position();
 
+/**
+ * Returns the current motor position in counts of 1/POSITION_SCALE
+ * full steps. The counter is read atomically.
+ */
+int32_t get_position_cnt();
+
 motor_state_t get_motor_state();
 
 switch_state_t get_switch_state();
@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Binary command protocol for high rate motion control
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef BINPROTO_H
+#define BINPROTO_H
+
+#include <stdint.h>
+
+/*
+ * Frame layout, all multi byte values little endian:
+ *
+ *   SYNC | opcode | payload (fixed size per opcode) | CRC-8
+ *
+ * The CRC-8 (polynomial 0x07, initial value 0) covers opcode and
+ * payload. A reply carries the request opcode with BINPROTO_REPLY set.
+ * SYNC is not a valid ASCII character, so a frame is recognised by its
+ * first byte whenever no SCPI line is being received.
+ */
+#define BINPROTO_SYNC 0xA5
+#define BINPROTO_REPLY 0x80
+
+#define BINPROTO_MOVE_ABS 0x01	// int32 target in position counts -> uint8 motion_result_t
+#define BINPROTO_MOVE_REL 0x02	// int32 distance in position counts -> uint8 motion_result_t
+#define BINPROTO_STOP 0x03		// no payload -> uint8 motion_result_t
+#define BINPROTO_SNAPSHOT 0x04	// no payload -> int32 position, uint8 motor_state_t, uint8 switch_state_t
+#define BINPROTO_PVT 0x05		// int32 position, int32 velocity, uint16 time -> uint8 motion_result_t, uint8 free points
+#define BINPROTO_PVT_START 0x06	// no payload -> uint8 motion_result_t
+#define BINPROTO_NAK 0x7F		// reply only, uint8 reason
+
+#define BINPROTO_NAK_CRC 1
+
+#define BINPROTO_FRAME_MAX 12	// opcode, largest payload and CRC, without SYNC
+
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+/**
+ * Returns the payload length of a request opcode, or 0xFF if the
+ * opcode is unknown. Used by the receive interrupt to find the end of
+ * a frame.
+ */
+static inline uint8_t binproto_payload_len(uint8_t opcode){
+	switch(opcode){
+		case BINPROTO_MOVE_ABS:
+		case BINPROTO_MOVE_REL:
+			return 4;
+		case BINPROTO_PVT:
+			return 10;
+		case BINPROTO_STOP:
+		case BINPROTO_SNAPSHOT:
+		case BINPROTO_PVT_START:
+			return 0;
+		default:
+			return 0xFF;
+	}
+}
+
+/**
+ * Check and execute a received frame (opcode, payload, CRC) and queue
+ * the reply frame for transmission.
+ */
+void binproto_execute(const uint8_t* frame);
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
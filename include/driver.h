@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Compile time selection of the step/dir driver
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef DRIVER_H
+#define DRIVER_H
+
+/*
+ * Build with one of -DDRIVER_DRV8825, -DDRIVER_TMC2208 or
+ * -DDRIVER_TMC2209, the A4988 is used otherwise. All drivers sit in the
+ * same carrier socket, see the pin map in pins.h. The driver header
+ * defines:
+ *
+ *   DRIVER_NAME                 name reported by :MOTor:DRIVer?
+ *   DRIVER_MICROSTEPS_MAX       finest microstep mode, the position
+ *                               counter resolution
+ *   DRIVER_MICROSTEPS_DEFAULT   mode set at startup
+ *   DRIVER_MS_<mode>            levels of the MS pins for each supported
+ *                               mode, MS_PIN1 | MS_PIN2 | MS_PIN3
+ *   DRIVER_SLEEP_RESET          1 if the SLEEP and RESET socket pins are
+ *                               active low nSLEEP and nRESET inputs,
+ *                               0 to keep them low
+ *   DRIVER_STEP_PULSE_NS        minimum STEP high and low time
+ *   DRIVER_DIR_SETUP_NS         minimum DIR setup time before a step
+ *   DRIVER_STEP_RATE_MAX        maximum step frequency in Hz
+ */
+#define MS_PIN1 0x01
+#define MS_PIN2 0x02
+#define MS_PIN3 0x04
+
+#if defined(DRIVER_DRV8825) + defined(DRIVER_TMC2208) + defined(DRIVER_TMC2209) > 1
+#error "select only one driver"
+#endif
+
+#if defined(DRIVER_DRV8825)
+#include "driver_drv8825.h"
+#elif defined(DRIVER_TMC2208)
+#include "driver_tmc2208.h"
+#elif defined(DRIVER_TMC2209)
+#include "driver_tmc2209.h"
+#else
+#include "driver_a4988.h"
+#endif
+
+#endif
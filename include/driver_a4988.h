@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Allegro A4988 driver traits
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef DRIVER_A4988_H
+#define DRIVER_A4988_H
+
+#define DRIVER_NAME "A4988"
+#define DRIVER_MICROSTEPS_MAX 16
+#define DRIVER_MICROSTEPS_DEFAULT 4
+
+/* MS1, MS2, MS3 */
+#define DRIVER_MS_FULL 0
+#define DRIVER_MS_HALF (MS_PIN1)
+#define DRIVER_MS_QUARTER (MS_PIN2)
+#define DRIVER_MS_EIGHTH (MS_PIN1 | MS_PIN2)
+#define DRIVER_MS_SIXTEENTH (MS_PIN1 | MS_PIN2 | MS_PIN3)
+
+#define DRIVER_SLEEP_RESET 1
+
+#define DRIVER_STEP_PULSE_NS 1000
+#define DRIVER_DIR_SETUP_NS 200
+#define DRIVER_STEP_RATE_MAX 500000L
+
+#endif
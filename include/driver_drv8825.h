@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * TI DRV8825 driver traits
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef DRIVER_DRV8825_H
+#define DRIVER_DRV8825_H
+
+#define DRIVER_NAME "DRV8825"
+#define DRIVER_MICROSTEPS_MAX 32
+#define DRIVER_MICROSTEPS_DEFAULT 4
+
+/* MODE0, MODE1, MODE2 on the MS1, MS2, MS3 socket pins */
+#define DRIVER_MS_FULL 0
+#define DRIVER_MS_HALF (MS_PIN1)
+#define DRIVER_MS_QUARTER (MS_PIN2)
+#define DRIVER_MS_EIGHTH (MS_PIN1 | MS_PIN2)
+#define DRIVER_MS_SIXTEENTH (MS_PIN3)
+#define DRIVER_MS_THIRTYSECOND (MS_PIN1 | MS_PIN3)
+
+#define DRIVER_SLEEP_RESET 1
+
+#define DRIVER_STEP_PULSE_NS 1900
+#define DRIVER_DIR_SETUP_NS 650
+#define DRIVER_STEP_RATE_MAX 250000L
+
+#endif
@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Trinamic TMC2208 driver traits, standalone step/dir mode
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef DRIVER_TMC2208_H
+#define DRIVER_TMC2208_H
+
+#define DRIVER_NAME "TMC2208"
+#define DRIVER_MICROSTEPS_MAX 16	// the driver interpolates every mode to 1/256
+#define DRIVER_MICROSTEPS_DEFAULT 4
+
+/* MS1, MS2 */
+#define DRIVER_MS_HALF (MS_PIN1)
+#define DRIVER_MS_QUARTER (MS_PIN2)
+#define DRIVER_MS_EIGHTH 0
+#define DRIVER_MS_SIXTEENTH (MS_PIN1 | MS_PIN2)
+
+/*
+ * SilentStepStick boards carry PDN_UART on the MS3 and RESET socket
+ * pins and CLK on the SLEEP pin. Low levels select normal operation and
+ * the internal clock.
+ */
+#define DRIVER_SLEEP_RESET 0
+
+#define DRIVER_STEP_PULSE_NS 100
+#define DRIVER_DIR_SETUP_NS 20
+#define DRIVER_STEP_RATE_MAX 1000000L
+
+#endif
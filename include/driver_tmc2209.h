@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Trinamic TMC2209 driver traits, standalone step/dir mode
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef DRIVER_TMC2209_H
+#define DRIVER_TMC2209_H
+
+#define DRIVER_NAME "TMC2209"
+#define DRIVER_MICROSTEPS_MAX 64	// the driver interpolates every mode to 1/256
+#define DRIVER_MICROSTEPS_DEFAULT 8
+
+/* MS1, MS2 */
+#define DRIVER_MS_EIGHTH 0
+#define DRIVER_MS_SIXTEENTH (MS_PIN1 | MS_PIN2)
+#define DRIVER_MS_THIRTYSECOND (MS_PIN1)
+#define DRIVER_MS_SIXTYFOURTH (MS_PIN2)
+
+/*
+ * The MS3 and RESET socket pins carry PDN_UART, the SLEEP pin is not
+ * connected or CLK. Low levels select normal operation and the internal
+ * clock.
+ */
+#define DRIVER_SLEEP_RESET 0
+
+#define DRIVER_STEP_PULSE_NS 100
+#define DRIVER_DIR_SETUP_NS 20
+#define DRIVER_STEP_RATE_MAX 1000000L
+
+#endif
@@ -0,0 +1,108 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Stored command sequences (macros)
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef MACRO_H
+#define MACRO_H
+
+#include <stdint.h>
+#include <scpiparser.h>
+
+/* A macro takes MACRO_NAME_MAX + 2 + 3 * MACRO_STEPS + MACRO_TEXT bytes of RAM */
+#ifndef MACRO_COUNT
+#define MACRO_COUNT 2		// number of macros, set with -DMACRO_COUNT=
+#endif
+#define MACRO_NAME_MAX 8	// characters of a macro name
+#ifndef MACRO_STEPS
+#define MACRO_STEPS 8		// commands per macro
+#endif
+#ifndef MACRO_TEXT
+#define MACRO_TEXT 32		// bytes of argument text per macro, up to 255
+#endif
+
+/*
+ * A macro is a list of SCPI commands, given as one compound message
+ * "<cmd>;<cmd>;...". The headers are resolved against the command tree
+ * once when the macro is defined, each step keeps the callback and its
+ * arguments already split into tokens. Arguments stay text, numbers and
+ * units are converted when the step runs, with the scale and unit in
+ * effect then.
+ *
+ * macro_service() runs one step per main loop iteration. A step that
+ * suspends (*WAI, *OPC?) is repeated until the motor stops and the scan
+ * ends, so *WAI waits for motion complete inside a macro. Macros are
+ * kept in RAM only, the callbacks are not valid across firmware builds.
+ */
+
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+typedef enum macro_result{
+	MACRO_OK = 0,
+	MACRO_BUSY = 1,			// a macro runs
+	MACRO_UNKNOWN = 2,		// no macro of that name
+	MACRO_FULL = 3,			// out of macros, steps or argument text
+	MACRO_UNDEFINED = 4,	// a command of the body is not in the tree
+	MACRO_INVALID = 5		// empty or overlong name, empty body
+} macro_result_t;
+
+/**
+ * Define the macro name with the commands of body, a compound message.
+ * The body is not modified. If append is set, the steps
+ * are added to an existing macro instead of replacing it. Refused with
+ * MACRO_BUSY while a macro runs, a refused definition leaves the macro
+ * unchanged. Only if all MACRO_COUNT slots are taken, a macro is
+ * redefined in place and a refused definition deletes it.
+ */
+macro_result_t macro_define(struct scpi_parser_context* ctx, const char* name, uint8_t name_length, const char* body, uint8_t length, uint8_t append);
+
+/**
+ * Delete a macro. Refused with MACRO_BUSY while a macro runs.
+ */
+macro_result_t macro_delete(const char* name, uint8_t name_length);
+
+/**
+ * Run a macro loops times, 1 to 65535. Refused with MACRO_BUSY while a
+ * macro runs, macros cannot run macros.
+ */
+macro_result_t macro_run(const char* name, uint8_t name_length, uint16_t loops);
+
+/**
+ * Abort a running macro after the current step.
+ */
+void macro_stop();
+
+/**
+ * Returns 1 from macro_run() until the last loop has ended or the macro
+ * was aborted. Returns 0 while a step of the macro executes, so its own
+ * *WAI only waits for the motor.
+ */
+uint8_t macro_running();
+
+/**
+ * Loops done and loops requested of the current or last run.
+ */
+uint16_t macro_loops_done();
+
+uint16_t macro_loops();
+
+/**
+ * Name of the macro stored in slot index, NULL if the slot is empty.
+ * Not terminated if MACRO_NAME_MAX characters long.
+ */
+const char* macro_name(uint8_t index);
+
+/**
+ * Called from the main loop, executes the next step of a running macro.
+ */
+void macro_service(struct scpi_parser_context* ctx);
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
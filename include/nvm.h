@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Configuration profiles and position journal in EEPROM
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef NVM_H
+#define NVM_H
+
+#include <stdint.h>
+
+#define NVM_PROFILES 4		// profile slots for *SAV/*RCL, slot 0 is loaded at power-on
+#define NVM_VERSION 2		// layout version of a profile, older profiles are rejected
+#define NVM_JOURNAL_SLOTS 48	// position journal ring, 10 bytes per entry
+#define NVM_JOURNAL_SETTLE_MS 1000	// standstill before the end of a motion is journaled
+
+/* journal entry flags */
+#define NVM_JOURNAL_STOPPED 0x01	// position written after the motor stopped
+#define NVM_JOURNAL_MOVING 0x02		// a move started from this position
+#define NVM_JOURNAL_POWER_FAIL 0x04	// written by the power-fail interrupt
+
+/*
+ * Wear budget: the EEPROM is specified for 100000 writes per cell. The
+ * ring spreads the entries over NVM_JOURNAL_SLOTS slots, so it takes
+ * 48 * 100000 = 4.8 million entries, at two entries per motion 2.4
+ * million motions. A motion ends only after the axis stood still for
+ * NVM_JOURNAL_SETTLE_MS with no scan, macro, position list or
+ * trajectory active, so a scan of any number of passes costs two
+ * entries and a host sending moves back to back costs at most two
+ * entries per second. That is 2.4 million seconds, 28 days, of
+ * uninterrupted single moves at the worst case, and decades at a few
+ * hundred motions per day.
+ */
+
+/*
+ * Define NVM_POWER_FAIL to halt the motor and write a final journal
+ * entry when the power-fail input PC1 (active low, e.g. from a supply
+ * supervisor) goes low. In the worst case the rest of a pending entry
+ * and the final one are written, 20 EEPROM bytes of 3.4 ms each, so
+ * the supply must hold up for 72 ms including a write in progress.
+ * After a dip the watchdog resets the controller, setup() turns it off
+ * again.
+ */
+
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+/**
+ * Store speed limit, acceleration, deceleration, both softlimits, the
+ * axis scale and the report unit in profile slot. The EEPROM is only written where the content changes.
+ */
+void nvm_save_profile(uint8_t slot);
+
+/**
+ * Load profile slot. Returns 0 and leaves the settings unchanged if the
+ * slot is empty, has a different layout version or a wrong CRC.
+ */
+uint8_t nvm_recall_profile(uint8_t slot);
+
+/**
+ * Restore the position counter from the newest valid journal entry and
+ * setup the optional power-fail input. Call once before interrupts are
+ * enabled.
+ */
+void nvm_init();
+
+/**
+ * Called from the main loop. Journals the position when a motion
+ * starts, when the axis has settled after it and when the counter is
+ * set while the motor stands still. Entries are written one byte per
+ * call whenever the EEPROM is ready, so the main loop is never blocked
+ * by a write.
+ */
+void nvm_journal_service();
+
+/**
+ * Returns 1 if the position counter can be trusted: it was restored
+ * from an entry written after the motor stopped, or it was set by the
+ * host since startup. Returns 0 after a power loss during a move or if
+ * no journal entry was found.
+ */
+uint8_t nvm_position_trusted();
+
+/**
+ * Mark the position counter as trusted, called when the host sets it.
+ */
+void nvm_position_confirmed();
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Pin access with port and bit kept together
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef PINS_H
+#define PINS_H
+
+#include <avr/io.h>
+
+/*
+ * A pin is defined as its port letter and bit number, e.g.
+ *
+ *   #define PIN_STEP B, 3
+ *
+ * and used with the macros below only. Port and bit are compile time
+ * constants, so PIN_HIGH() and PIN_LOW() compile to a single sbi or cbi
+ * and PIN_READ() in a condition to a single sbic or sbis on ports A to D
+ * of the ATmega328. Both are atomic, no interrupt can intervene between
+ * reading and writing back the port register.
+ */
+#define PIN_OUTPUT(pin) PIN_OUTPUT_(pin)
+#define PIN_INPUT(pin) PIN_INPUT_(pin)
+#define PIN_HIGH(pin) PIN_HIGH_(pin)
+#define PIN_LOW(pin) PIN_LOW_(pin)
+#define PIN_WRITE(pin, value) PIN_WRITE_(value, pin)
+#define PIN_READ(pin) PIN_READ_(pin)
+
+/* input pin helpers, the port bit selects the pull-up */
+#define PIN_PULLUP(pin) PIN_HIGH_(pin)
+#define PIN_TRISTATE(pin) PIN_LOW_(pin)
+
+/* pin change interrupt of the pin, its vector is PIN_PCINT_vect(pin) */
+#define PIN_PCINT_ENABLE(pin) PIN_PCINT_ENABLE_(pin)
+#define PIN_PCINT_vect(pin) PIN_PCINT_vect_(pin)
+
+#define PIN_OUTPUT_(port, bit) (DDR##port |= _BV(bit))
+#define PIN_INPUT_(port, bit) (DDR##port &= ~_BV(bit))
+#define PIN_HIGH_(port, bit) (PORT##port |= _BV(bit))
+#define PIN_LOW_(port, bit) (PORT##port &= ~_BV(bit))
+#define PIN_WRITE_(value, port, bit) do{ if(value) PIN_HIGH_(port, bit); else PIN_LOW_(port, bit); } while(0)
+#define PIN_READ_(port, bit) (PIN##port & _BV(bit))
+
+#define PIN_PCINT_ENABLE_(port, bit) do{ PCMSK_##port |= _BV(bit); PCICR |= _BV(PCIE_##port); } while(0)
+#define PIN_PCINT_vect_(port, bit) PCINT_vect_##port
+
+/* pin change interrupt registers of each port */
+#define PCMSK_B PCMSK0
+#define PCMSK_C PCMSK1
+#define PCMSK_D PCMSK2
+#define PCIE_B PCIE0
+#define PCIE_C PCIE1
+#define PCIE_D PCIE2
+#define PCINT_vect_B PCINT0_vect
+#define PCINT_vect_C PCINT1_vect
+#define PCINT_vect_D PCINT2_vect
+
+
+/*
+ * Board pin map. The driver pins follow the carrier socket and are
+ * shared by all drivers, see driver.h.
+ */
+#define PIN_DIR B, 4
+#define PIN_STEP B, 3
+#define PIN_SLEEP B, 2		// active low
+#define PIN_RESET B, 1		// active low
+#define PIN_MS3 B, 0
+
+#define PIN_ENABLE D, 5		// active low
+#define PIN_MS1 D, 6
+#define PIN_MS2 D, 7
+
+/* both switches have to be on the same port, they share one pin change interrupt */
+#define PIN_SW_NEG D, 2		// active low
+#define PIN_SW_POS D, 4		// active low
+
+#define PIN_LED B, 5		// lit while a limit switch is active
+#define PIN_POWER_FAIL C, 1	// active low, only used with NVM_POWER_FAIL
+#define PIN_TRIGGER C, 0	// scan trigger output, see scan.h
+#define PIN_LIST_TRIGGER D, 3	// INT1, position list trigger input, see sequence.h
+
+#endif
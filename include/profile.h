@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Optional run time profiling, enabled with -DPROFILE
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+/*
+ * Durations are measured with Timer0, which the Arduino core runs with
+ * prescaler 64 for millis(). One tick is PROFILE_TICK_CYCLES CPU
+ * cycles. PROFILE_BEGIN/END read TCNT0 directly and are meant for ISRs,
+ * sections must be shorter than 256 ticks (1 ms). The _LONG variants
+ * use micros() and need Arduino.h.
+ */
+#define PROFILE_TICK_CYCLES 64
+
+#define PROFILE_STEP_ISR 0	// Timer1 step pulse ISR
+#define PROFILE_COMMAND 1	// one SCPI message, parsing and execution
+#define PROFILE_FRAME 2		// one binary frame
+#define PROFILE_LOOP 3		// one main loop iteration, the worst case is the command latency
+#define PROFILE_SLOTS 4
+
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+#ifdef PROFILE
+
+#include <avr/io.h>
+
+#define PROFILE_BEGIN(name) uint8_t name = TCNT0
+#define PROFILE_END(slot, name) profile_add(slot, (uint8_t)(TCNT0 - name))
+#define PROFILE_BEGIN_LONG(name) unsigned long name = micros()
+#define PROFILE_END_LONG(slot, name) profile_add_us(slot, micros() - name)
+
+/**
+ * Add a measured duration in Timer0 ticks to slot. Each slot must only
+ * be used from one context, either an ISR or the main loop.
+ */
+void profile_add(uint8_t slot, uint16_t ticks);
+
+void profile_add_us(uint8_t slot, unsigned long us);
+
+void profile_reset();
+
+/**
+ * Print "name,count,mean,max" for every slot into response_buffer,
+ * separated by semicolons, mean and max in CPU cycles.
+ */
+void profile_report();
+
+#else
+
+#define PROFILE_BEGIN(name)
+#define PROFILE_END(slot, name)
+#define PROFILE_BEGIN_LONG(name)
+#define PROFILE_END_LONG(slot, name)
+
+#endif
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
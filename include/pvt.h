@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Position-velocity-time trajectories
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef PVT_H
+#define PVT_H
+
+#include <stdint.h>
+
+#include "A4988.h"
+
+#ifndef PVT_POINTS
+#define PVT_POINTS 8		// queued points, 10 bytes of RAM each, set with -DPVT_POINTS=
+#endif
+#define PVT_TIME_MAX 10000	// longest segment in ms
+
+/* trajectory status */
+#define PVT_IDLE 0			// no trajectory, or the last one ended at a point with velocity 0
+#define PVT_RUNNING 1
+#define PVT_UNDERRUN 2		// the queue ran empty at a point with velocity != 0
+#define PVT_ABORTED 3		// stopped by :MOT:STOP, a limit switch or PVT:CLEar
+
+/*
+ * A trajectory is a sequence of points, each with position (counts),
+ * velocity (counts per second) and the time in ms to get there from
+ * the previous point. The first segment starts at the current position
+ * with velocity 0. Between two points the position follows the cubic
+ * Hermite curve through both positions and velocities. The curve is
+ * evaluated at every tick (1 ms, Timer2 compare B, enabled only while a
+ * trajectory runs) and the step ISR follows it, see follow_target().
+ * soft_stop() brakes from the current velocity and drops the rest of
+ * the trajectory, the status becomes PVT_ABORTED once the motor stopped.
+ *
+ * The segment after the running one is prepared in the main loop, so
+ * the tick only evaluates a polynomial and changing segments costs
+ * nothing. The trajectory ends at the last queued point if its
+ * velocity is 0, otherwise the motor is halted and the status becomes
+ * PVT_UNDERRUN. On underrun or abort the queue is cleared.
+ */
+
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+/**
+ * Queue a point. Refused with MOTION_BUFFER_FULL, MOTION_INVALID if
+ * time is 0 or above PVT_TIME_MAX, or a softlimit result if the
+ * position lies outside the softlimits. The curve between two points
+ * may overshoot them, the motor is then held at the softlimit.
+ */
+motion_result_t pvt_add(int32_t position, int32_t velocity, uint16_t time);
+
+/**
+ * Start the trajectory from the current position. Refused with
+ * MOTION_INVALID if no point is queued, otherwise as follow_start().
+ */
+motion_result_t pvt_start();
+
+/**
+ * Drop all queued points, a running trajectory is halted.
+ */
+void pvt_clear();
+
+/**
+ * Number of free point slots. The host keeps the queue filled by
+ * sending a point whenever a slot becomes free.
+ */
+uint8_t pvt_free();
+
+uint8_t pvt_status();
+
+/**
+ * Called from the main loop. Prepares the next segment.
+ */
+void pvt_service();
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
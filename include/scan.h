@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Oscillation and raster scans between two positions
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdint.h>
+
+#include "A4988.h"
+
+/* scan modes */
+#define SCAN_OSCILLATE 0	// start -> stop -> start -> ..., every leg is a pass
+#define SCAN_RASTER 1		// start -> stop, return to start, every pass in the same direction
+
+#define SCAN_TRIGGER_US 10	// width of the turnaround trigger pulse
+
+/*
+ * A scan first moves to start, then runs count passes with the ramp
+ * engine, waiting dwell ms before every pass. If enabled, the trigger
+ * output PIN_TRIGGER pulses high at the end of every pass. The scan is
+ * driven by scan_service() in the main loop, so turnarounds and trigger
+ * pulses are delayed by up to one main loop iteration.
+ *
+ * The scan is aborted if the motor stops anywhere else than at the
+ * target of its move (limit switch, :MOT:STOP) or another command moves
+ * the motor during a dwell.
+ */
+
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+/**
+ * Start a scan, positions in counts. Refused with MOTION_BUSY while the
+ * motor moves, with a softlimit result if start or stop lies outside
+ * the softlimits and with MOTION_INVALID if start equals stop or count
+ * is 0.
+ */
+motion_result_t scan_start(int32_t start, int32_t stop, uint16_t count, uint16_t dwell);
+
+/**
+ * Abort a running scan, the running move is not stopped.
+ */
+void scan_stop();
+
+void scan_set_mode(uint8_t mode);
+
+uint8_t scan_get_mode();
+
+/**
+ * Enable or disable the trigger pulses. The trigger pin is an output
+ * only while enabled.
+ */
+void scan_set_trigger(uint8_t enable);
+
+uint8_t scan_get_trigger();
+
+/**
+ * Returns 1 from scan_start() until the last pass has ended or the scan
+ * was aborted.
+ */
+uint8_t scan_running();
+
+/**
+ * Passes done and passes requested of the current or last scan.
+ */
+uint16_t scan_passes_done();
+
+uint16_t scan_passes();
+
+/**
+ * Called from the main loop, starts the next move or dwell once the
+ * motor has stopped.
+ */
+void scan_service();
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
@@ -19,6 +19,12 @@ extern char response_buffer[BUF_LEN];
 extern uint8_t response_len;
 
 
+/**
+ * Push an error onto the error queue. The description has to be
+ * stored in flash.
+ */
+void queue_error(int id, const char* description);
+
 /**
  * Respond to *IDN?
  */
@@ -104,10 +110,202 @@ scpi_error_t scpi_set_position(struct scpi_parser_context* context, struct scpi_
 
 scpi_error_t scpi_get_state(struct scpi_parser_context* context, struct scpi_token* command);
 
+/**
+ * Start or stop (rate 0) the telemetry stream.
+ */
+scpi_error_t scpi_set_stream(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_get_stream(struct scpi_parser_context* context, struct scpi_token* command);
+
+/**
+ * Motion trace recorder, see trace.h. DATA? sends its block directly
+ * and should be the last query of a message.
+ */
+scpi_error_t scpi_set_trace_decimation(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_get_trace_decimation(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_get_trace_count(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_get_trace_data(struct scpi_parser_context* context, struct scpi_token* command);
+
+/**
+ * Axis scale and report unit, see units.h.
+ */
+scpi_error_t scpi_set_scale(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_get_scale(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_set_unit(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_get_unit(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_get_driver(struct scpi_parser_context* context, struct scpi_token* command);
+
+/**
+ * Trajectory points, see pvt.h.
+ */
+scpi_error_t scpi_add_pvt(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_start_pvt(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_clear_pvt(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_get_pvt_free(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_get_pvt_state(struct scpi_parser_context* context, struct scpi_token* command);
+
+/**
+ * Scans between two positions, see scan.h.
+ */
+scpi_error_t scpi_start_scan(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_set_scan_mode(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_get_scan_mode(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_set_scan_trigger(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_get_scan_trigger(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_get_scan_progress(struct scpi_parser_context* context, struct scpi_token* command);
+
+/**
+ * Respond with 1 if the journaled position restored at startup can be
+ * trusted, see nvm_position_trusted().
+ */
+scpi_error_t scpi_get_position_valid(struct scpi_parser_context* context, struct scpi_token* command);
+
+/**
+ * *SAV and *RCL, settings profiles in EEPROM, see nvm.h.
+ */
+scpi_error_t scpi_save_profile(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_recall_profile(struct scpi_parser_context* context, struct scpi_token* command);
+
+#ifdef PROFILE
+/**
+ * Respond with the profiling statistics, see profile_report().
+ */
+scpi_error_t scpi_get_profile(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_reset_profile(struct scpi_parser_context* context, struct scpi_token* command);
+#endif
+
 scpi_error_t scpi_home_pos(struct scpi_parser_context* context, struct scpi_token* command);
 
 scpi_error_t scpi_home_neg(struct scpi_parser_context* context, struct scpi_token* command);
 
+/**
+ * Set the baud rate, optionally store it as power-on rate.
+ */
+scpi_error_t scpi_set_baud(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_get_baud(struct scpi_parser_context* context, struct scpi_token* command);
+
+/**
+ * Respond with the transmit buffer statistics "dropped,stalled".
+ */
+scpi_error_t scpi_get_tx_statistics(struct scpi_parser_context* context, struct scpi_token* command);
+
+/**
+ * Append positions "<pos>[,<pos>...]" to the trigger position list, see
+ * sequence.h.
+ */
+scpi_error_t scpi_add_list(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_clear_list(struct scpi_parser_context* context, struct scpi_token* command);
+
+/**
+ * Arm or disarm the position list.
+ */
+scpi_error_t scpi_start_list(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_stop_list(struct scpi_parser_context* context, struct scpi_token* command);
+
+/**
+ * Set the trigger edge (RISing|FALLing).
+ */
+scpi_error_t scpi_set_list_edge(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_get_list_edge(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_get_list_count(struct scpi_parser_context* context, struct scpi_token* command);
+
+/**
+ * Respond with the index of the next entry, the number of moves started.
+ */
+scpi_error_t scpi_get_list_index(struct scpi_parser_context* context, struct scpi_token* command);
+
+/**
+ * Respond with the number of triggers ignored while the motor moved.
+ */
+scpi_error_t scpi_get_list_overruns(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_get_list_state(struct scpi_parser_context* context, struct scpi_token* command);
+
+/**
+ * Define a macro "<name>,\"<cmd>;<cmd>;...\"", or append commands to
+ * it. See macro.h.
+ */
+scpi_error_t scpi_define_macro(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_append_macro(struct scpi_parser_context* context, struct scpi_token* command);
+
+/**
+ * Run a macro "<name>[,<loops>]" in the main loop.
+ */
+scpi_error_t scpi_run_macro(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_stop_macro(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_delete_macro(struct scpi_parser_context* context, struct scpi_token* command);
+
+/**
+ * Respond with the quoted names of the stored macros.
+ */
+scpi_error_t scpi_get_macro_catalog(struct scpi_parser_context* context, struct scpi_token* command);
+
+/**
+ * Respond with "<loops done>,<loops>,<running>".
+ */
+scpi_error_t scpi_get_macro_progress(struct scpi_parser_context* context, struct scpi_token* command);
+
+/**
+ * *OPC sets bit 0 of the event status register once the motor stops,
+ * *OPC? and *WAI hold the message until the motor stops.
+ */
+scpi_error_t scpi_operation_complete(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_operation_complete_query(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_wait(struct scpi_parser_context* context, struct scpi_token* command);
+
+/**
+ * Respond with the event status register and clear it.
+ */
+scpi_error_t scpi_get_event_status(struct scpi_parser_context* context, struct scpi_token* command);
+
+/**
+ * Enable or disable the unsolicited event lines (ON|OFF|1|0).
+ */
+scpi_error_t scpi_set_events(struct scpi_parser_context* context, struct scpi_token* command);
+
+scpi_error_t scpi_get_events(struct scpi_parser_context* context, struct scpi_token* command);
+
+/**
+ * Called from the main loop after the motor stopped or a limit switch
+ * tripped. Completes a pending *OPC and sends the event line
+ * "!<state>" if enabled, unless a scan or macro continues.
+ */
+void scpi_motion_event();
+
+/**
+ * Returns 1 while the motor moves, a scan or a macro runs, *OPC, *OPC?
+ * and *WAI wait for the end of all of them.
+ */
+uint8_t scpi_operation_pending();
+
 
 
 
@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Position list advanced by an external trigger
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include <stdint.h>
+
+#include "A4988.h"
+
+#ifndef SEQUENCE_POINTS
+#define SEQUENCE_POINTS 16	// entries of the position list, 4 bytes of RAM each, set with -DSEQUENCE_POINTS=
+#endif
+
+/* trigger edges */
+#define SEQUENCE_RISING 0
+#define SEQUENCE_FALLING 1
+
+/*
+ * While armed, every edge on PIN_LIST_TRIGGER (INT1) starts the move to
+ * the next entry of the list from the interrupt, with the first step
+ * within a few µs. The move to each entry is planned in the main loop
+ * as soon as the motor stopped, with the speed and ramps at that time.
+ * A trigger that arrives while the motor still moves, or before the
+ * next move is planned, is counted as overrun and ignored.
+ *
+ * The list is disarmed after the move to the last entry, if a move is
+ * refused at a limit switch or softlimit, and by :MOT:STOP. Moves by
+ * other commands in between are allowed, the next move is planned again
+ * from the new position.
+ */
+
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+/**
+ * Append a position, in counts. Refused with MOTION_BUFFER_FULL if the
+ * list is full and with MOTION_BUSY while armed.
+ */
+motion_result_t sequence_add(int32_t position);
+
+/**
+ * Drop all entries, disarms the list.
+ */
+void sequence_clear();
+
+/**
+ * Arm the list from its first entry and reset the overrun counter.
+ * Refused with MOTION_INVALID if the list is empty, with a softlimit
+ * result if an entry lies outside the softlimits.
+ */
+motion_result_t sequence_start();
+
+/**
+ * Disarm, a running move is not stopped.
+ */
+void sequence_stop();
+
+void sequence_set_edge(uint8_t edge);
+
+uint8_t sequence_get_edge();
+
+uint8_t sequence_armed();
+
+/**
+ * Number of entries whose move was started, the index of the next one.
+ */
+uint8_t sequence_index();
+
+uint8_t sequence_count();
+
+/**
+ * Triggers ignored since sequence_start().
+ */
+uint16_t sequence_overruns();
+
+/**
+ * Called from the main loop, plans the move to the next entry once the
+ * motor has stopped.
+ */
+void sequence_service();
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
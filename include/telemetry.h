@@ -0,0 +1,69 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Periodic position/velocity telemetry records
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+#define TELEMETRY_TICK_HZ 1000	// Timer2 tick rate
+#define TELEMETRY_RATE_MAX 200	// records per second
+
+/*
+ * Record layout, one text line per record:
+ *
+ *   =<position>,<velocity>,<motor state>,<switch state>\n
+ *
+ * Position in counts of 1/POSITION_SCALE full steps, velocity in counts
+ * per second over the last record period, states as motor_state_t and
+ * switch_state_t. The leading '=' tells records apart from responses
+ * and event lines.
+ */
+
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+/**
+ * Setup Timer2 for a 1 kHz CTC tick. The compare A interrupt is only
+ * enabled while streaming, compare B is the trajectory tick of pvt.c.
+ */
+void telemetry_init();
+
+/**
+ * Enable the compare A interrupt while streaming.
+ */
+void telemetry_tick_update();
+
+/**
+ * Start streaming with rate records per second, 1 to
+ * TELEMETRY_RATE_MAX. The rate is rounded to a whole number of ticks.
+ */
+void telemetry_start(uint16_t rate);
+
+/**
+ * Stop streaming. Called for every received command line or frame.
+ */
+void telemetry_stop();
+
+/**
+ * Current rate in records per second, 0 if not streaming.
+ */
+uint16_t telemetry_rate();
+
+/**
+ * Called from the main loop. Sends the pending record, if any. Records
+ * that do not fit into the transmit buffer are dropped and counted by
+ * uart_tx_dropped() instead of delaying the main loop.
+ */
+void telemetry_service();
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
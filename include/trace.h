@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Motion trace recorder
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#ifndef TRACE_LEN
+#define TRACE_LEN 32			// samples, TRACE_LEN * 5 bytes of RAM, set with -DTRACE_LEN=
+#endif
+#define TRACE_SAMPLE_SIZE 5		// bytes per sample in the data block
+
+/* phase of a sample */
+#define TRACE_ACCELERATE 0
+#define TRACE_CONSTANT 1
+#define TRACE_DECELERATE 2
+#define TRACE_LAST_STEP 3
+
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+/**
+ * Record every trace_decimation-th step, 0 disables the recorder.
+ * Read by the step ISR.
+ */
+extern volatile uint8_t trace_decimation;
+
+/**
+ * Store a sample. Called from the step ISR, the oldest sample is
+ * overwritten once TRACE_LEN samples are stored.
+ */
+void trace_sample(uint16_t step, uint16_t interval, uint8_t phase);
+
+/**
+ * Drop all samples, called at the start of every move.
+ */
+void trace_clear();
+
+void trace_set_decimation(uint8_t decimation);
+
+/**
+ * Number of stored samples and number of samples recorded during the
+ * last move, including overwritten ones.
+ */
+uint8_t trace_count();
+
+uint32_t trace_recorded();
+
+/**
+ * Send all stored samples, oldest first, as IEEE 488.2 definite length
+ * block "#<digits><length><data>" followed by a line feed. Each sample
+ * is step (uint16), interval (uint16, OCR1A value timing the next step,
+ * 0 for the last step) and phase (uint8), little endian. Recording is
+ * paused while the block is sent.
+ */
+void trace_dump();
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Interrupt driven UART for the SCPI command line
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef UART_H
+#define UART_H
+
+#include <stdint.h>
+
+#define UART_RX_BUF_LEN 128	// receive ring buffer, holds several complete lines
+#define UART_LINE_MAX 96	// longer lines are dropped and reported
+#define UART_TX_BUF_LEN 128	// transmit ring buffer, must be a power of two
+#define UART_FRAME_SLOTS 4	// received binary frames waiting for the main loop
+#define UART_FRAME_TIMEOUT_MS 20	// longest pause within a binary frame, below 255
+
+#define UART_DEFAULT_BAUD 9600			// power-on rate and fallback
+#define UART_BAUD_CONFIRM_MS 5000		// a new rate falls back unless a line arrives in time
+
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+/**
+ * Setup USART0 for 8-N-1 at the given baud rate with receive
+ * interrupts enabled. Replaces the Arduino Serial object, which must
+ * not be used together with this driver.
+ */
+void uart_init(uint32_t baud);
+
+/**
+ * Returns 1 if baud is one of the supported rates 9600, 115200, 250000,
+ * 500000 or 1000000.
+ */
+uint8_t uart_baud_supported(uint32_t baud);
+
+/**
+ * Switch to a new baud rate once all queued output has been sent, see
+ * uart_service(). The new rate is only kept if a complete line is
+ * received within UART_BAUD_CONFIRM_MS and no framing error occurs
+ * before, otherwise the driver falls back to UART_DEFAULT_BAUD.
+ */
+void uart_set_baud(uint32_t baud);
+
+/**
+ * Returns the current baud rate.
+ */
+uint32_t uart_get_baud();
+
+/**
+ * Store baud as power-on rate in the EEPROM.
+ */
+void uart_save_baud(uint32_t baud);
+
+/**
+ * Returns the stored power-on rate, or UART_DEFAULT_BAUD if none is
+ * stored. Pass it to uart_init(), the driver falls back to
+ * UART_DEFAULT_BAUD on framing errors until the first line arrives.
+ */
+uint32_t uart_power_on_baud();
+
+/**
+ * Apply pending baud rate changes and the fallback. Call it from the
+ * main loop, it never blocks.
+ */
+void uart_service();
+
+/**
+ * Copy the oldest complete line from the receive buffer to buf. The
+ * line feed is not copied. Never blocks, the RX interrupt assembles
+ * the lines in the background.
+ *
+ * Returns the length of the line or -1 if no complete line is
+ * available.
+ */
+int16_t uart_read_line(char* buf, uint8_t size);
+
+/**
+ * Copy the oldest received binary frame (opcode, payload and CRC,
+ * without the sync byte) to buf, which must hold BINPROTO_FRAME_MAX
+ * bytes. Frames are recognised by their sync byte at the start of a
+ * line, see binproto.h. Frames that arrive while all UART_FRAME_SLOTS
+ * are taken are dropped, a frame interrupted for longer than
+ * UART_FRAME_TIMEOUT_MS is abandoned.
+ *
+ * Returns 1 if a frame was copied, 0 if none is available.
+ */
+uint8_t uart_read_frame(uint8_t* buf);
+
+/**
+ * Returns the number of lines dropped since the last call because they
+ * exceeded UART_LINE_MAX or did not fit into the receive buffer, and
+ * resets the counter.
+ */
+uint8_t uart_dropped_lines();
+
+/**
+ * Queue len bytes for transmission by the UDRE interrupt. Waits for
+ * free space only if the transmit buffer is full, every byte that had
+ * to wait is counted as stalled.
+ */
+void uart_write(const char* buf, uint8_t len);
+
+/**
+ * Queue len bytes only if all of them fit into the transmit buffer,
+ * otherwise drop them and count them as dropped. Never blocks, meant
+ * for periodic output that must not hold up the main loop.
+ *
+ * Returns 1 if the bytes were queued, 0 if they were dropped.
+ */
+uint8_t uart_try_write(const char* buf, uint8_t len);
+
+/**
+ * Returns the number of free bytes in the transmit buffer.
+ */
+uint8_t uart_tx_free();
+
+/**
+ * Block until the transmit buffer is empty and the last byte has left
+ * the shift register.
+ */
+void uart_flush();
+
+/**
+ * Number of bytes dropped by uart_try_write() and number of bytes that
+ * had to wait for free space in uart_write() since startup.
+ */
+uint32_t uart_tx_dropped();
+uint32_t uart_tx_stalled();
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Conversion between physical units and position counts
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef UNITS_H
+#define UNITS_H
+
+#include <stdint.h>
+
+#include "A4988.h"
+
+/*
+ * Physical values are handled as integers in base units, micrometres
+ * for linear axes and millidegrees for rotary axes. The axis scale is
+ * the exact ratio of scale_counts position counts per scale_base base
+ * units, e.g. 200 full steps per 2 mm lead is 3200 counts per 2000 um.
+ */
+#define UNIT_STEP 0		// full steps, no conversion
+#define UNIT_MM 1
+#define UNIT_UM 2
+#define UNIT_DEG 3
+#define UNIT_INVALID 0xFF
+
+#define UNITS_COUNTS_MAX (1000000L * POSITION_SCALE)	// limits of the scale ratio, keep the
+#define UNITS_BASE_MAX 1000000L		// 64 bit intermediates from overflowing
+
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+/**
+ * Look up a unit suffix (MM, UM or DEG, case insensitive). Returns
+ * UNIT_INVALID for anything else.
+ */
+uint8_t units_lookup(const char* str, uint8_t length);
+
+/**
+ * Base units per unit, 1000 for MM and DEG, 1 for UM.
+ */
+int32_t units_base_per_unit(uint8_t unit);
+
+/**
+ * Set the axis scale to counts position counts per base base units of
+ * axis unit (UNIT_MM or UNIT_UM for linear, UNIT_DEG for rotary axes).
+ * UNIT_STEP removes the scale. Returns 0 if the ratio is out of range.
+ */
+uint8_t units_set_scale(int32_t counts, int32_t base, uint8_t axis);
+
+void units_get_scale(int32_t* counts, int32_t* base, uint8_t* axis);
+
+/**
+ * Returns 1 if unit can be used with the current axis scale.
+ */
+uint8_t units_compatible(uint8_t unit);
+
+/**
+ * Unit of query responses, UNIT_STEP unless set to a compatible unit.
+ */
+uint8_t units_set_report(uint8_t unit);
+
+uint8_t units_get_report();
+
+/**
+ * Convert a value in base units into units of 1/scale full steps,
+ * rounded to the nearest integer. scale has to divide POSITION_SCALE.
+ * Returns 0 if the result does not fit into an int32_t.
+ */
+uint8_t units_to_steps(int32_t base, int32_t scale, int32_t* value);
+
+/**
+ * Convert a value in units of 1/scale full steps into base units,
+ * saturated to the int32_t range.
+ */
+int32_t units_from_steps(int32_t value, int32_t scale);
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
@@ -25,8 +25,6 @@ SOFTWARE.
 #include <stdlib.h>
 #include <ctype.h>
 
-#include <Arduino.h>
-
 #include "scpiparser.h"
 
 #ifdef __cplusplus
@@ -35,62 +33,165 @@ SOFTWARE.
   
 #endif
 
-static scpi_error_t
-system_error(struct scpi_parser_context* ctx, struct scpi_token* command)
+/** ----MODIFICATION---- */
+static const char scpi_no_error[] PROGMEM = "No error";
+static const char scpi_queue_overflow[] PROGMEM = "Queue overflow";
+static const char scpi_undefined_header[] PROGMEM = "Undefined header";
+static const char scpi_out_of_memory[] PROGMEM = "Out of memory";
+/** -------------------- */
+
+/** ----MODIFICATION---- */
+/* Built-in commands, listed in the command table of the application */
+scpi_error_t
+scpi_system_error(struct scpi_parser_context* ctx, struct scpi_token* command)
+/** -------------------- */
 {
-	struct scpi_error* error = scpi_pop_error(ctx);
+	struct scpi_error error = scpi_pop_error(ctx);
 	/** ----MODIFICATION---- */
-	response_len = snprintf(response_buffer, BUF_LEN, "%d,\"%s\"\n", error->id, error->description);
+	scpi_print_int(error.id);
+	scpi_puts_P(PSTR(",\""));
+	scpi_puts_P(error.description);
+	scpi_puts_P(PSTR("\"\n"));
 	/** -------------------- */
 	
-	/*
-	Serial.print(error->id);
-    Serial.print(",\"");
-    Serial.write((const uint8_t*)error->description, error->length);
-	Serial.println("\"");
-	*/
-	
 	scpi_free_tokens(command);
 	return SCPI_SUCCESS;
 }
 
+/** ----MODIFICATION---- */
+scpi_error_t
+scpi_system_error_count(struct scpi_parser_context* ctx, struct scpi_token* command)
+{
+	scpi_print_int(scpi_error_count(ctx));
+	scpi_putc('\n');
+	scpi_free_tokens(command);
+	return SCPI_SUCCESS;
+}
+
+scpi_error_t
+scpi_clear_status(struct scpi_parser_context* ctx, struct scpi_token* command)
+{
+	scpi_clear_errors(ctx);
+	scpi_free_tokens(command);
+	return SCPI_SUCCESS;
+}
+/** -------------------- */
+
+/** ----MODIFICATION---- */
+void
+scpi_putc(char c)
+{
+	if(response_len < BUF_LEN - 1 || (c == '\n' && response_len < BUF_LEN))
+	{
+		response_buffer[response_len++] = c;
+	}
+	else if(c == '\n')
+	{
+		/* full, end the truncated line anyway */
+		response_buffer[BUF_LEN - 1] = '\n';
+	}
+}
+
+void
+scpi_puts_P(const char* str)
+{
+	char c;
+	
+	while((c = pgm_read_byte(str++)) != '\0')
+	{
+		scpi_putc(c);
+	}
+}
+
+static void
+scpi_print_digits(uint32_t value, uint8_t min_digits)
+{
+	char digits[10];
+	uint8_t count;
+	
+	count = 0;
+	do
+	{
+		digits[count++] = '0' + (char)(value % 10);
+		value /= 10;
+	} while(value != 0 || count < min_digits);
+	
+	while(count > 0)
+	{
+		scpi_putc(digits[--count]);
+	}
+}
+
 void
-scpi_init(struct scpi_parser_context* ctx)
+scpi_print_int(int32_t value)
 {
-	struct scpi_command* system;
-	struct scpi_command* error;
-	
-	ctx->command_tree = (struct scpi_command*)malloc(sizeof(struct scpi_command));
-	
-	ctx->command_tree->long_name = NULL;
-	ctx->command_tree->long_name_length = 0;
-	
-	ctx->command_tree->short_name = NULL;
-	ctx->command_tree->short_name_length = 0;
-	
-	ctx->command_tree->callback = NULL;
-	ctx->command_tree->next = NULL;
-	ctx->command_tree->children = NULL;
-	
-	system = scpi_register_command(
-				ctx->command_tree, SCPI_CL_CHILD, "SYSTEM", 6,
-												  "SYST", 4, NULL);
-												  
-	error = scpi_register_command(
-				system, SCPI_CL_CHILD, "ERROR", 5,
-									   "ERR", 3, NULL);
-									   
-	scpi_register_command(
-				system, SCPI_CL_CHILD, "ERROR?", 6,
-									   "ERR?", 4, system_error);
-	
-	scpi_register_command(
-				error, SCPI_CL_CHILD, "NEXT?", 5, "NEXT?", 5, system_error);
-	
-	ctx->error_queue_head = NULL;
-	ctx->error_queue_tail = NULL;
+	if(value < 0)
+	{
+		scpi_putc('-');
+		scpi_print_digits(-(uint32_t)value, 1);
+	}
+	else
+	{
+		scpi_print_digits((uint32_t)value, 1);
+	}
 }
 
+void
+scpi_print_fixed(int32_t value, int32_t scale, uint8_t decimals)
+{
+	uint32_t magnitude;
+	uint32_t integer;
+	uint32_t fraction;
+	uint32_t multiplier;
+	uint8_t i;
+	
+	magnitude = (value < 0) ? -(uint32_t)value : (uint32_t)value;
+	
+	multiplier = 1;
+	for(i = 0; i < decimals; i++)
+	{
+		multiplier *= 10;
+	}
+	
+	/* Split first, so that the rounding of the fraction cannot overflow. */
+	integer = magnitude / (uint32_t)scale;
+	fraction = ((magnitude % (uint32_t)scale) * multiplier + (uint32_t)scale/2) / (uint32_t)scale;
+	if(fraction >= multiplier)
+	{
+		integer++;
+		fraction -= multiplier;
+	}
+	
+	if(value < 0 && (integer != 0 || fraction != 0))
+	{
+		scpi_putc('-');
+	}
+	
+	scpi_print_digits(integer, 1);
+	
+	if(decimals > 0)
+	{
+		scpi_putc('.');
+		scpi_print_digits(fraction, decimals);
+	}
+}
+/** -------------------- */
+
+/** ----MODIFICATION---- */
+void
+scpi_init(struct scpi_parser_context* ctx, const struct scpi_command* commands, uint8_t count)
+{
+	ctx->command_tree = commands;
+	ctx->command_count = count;
+	
+	scpi_clear_errors(ctx);
+	
+	ctx->current_path = NULL;
+	ctx->suspended_message = NULL;
+	ctx->suspend_request = 0;
+}
+/** -------------------- */
+
 struct scpi_token*
 scpi_parse_string(const char* str, size_t length)
 {
@@ -107,12 +208,18 @@ scpi_parse_string(const char* str, size_t length)
 	
 	for(i = 0; i < length; i++)
 	{
-		
 		if(str[i] == ':' || str[i] == ' ' || i == length-1)
 		{
 			struct scpi_token* new_tail;
 			
 			new_tail = (struct scpi_token*)malloc(sizeof(struct scpi_token));
+			/** ----MODIFICATION---- */
+			if(new_tail == NULL)
+			{
+				scpi_free_tokens(head);
+				return NULL;
+			}
+			/** -------------------- */
 			new_tail->type = 0;
 			new_tail->value = str+token_start;
 			new_tail->length = i-token_start;
@@ -154,6 +261,13 @@ scpi_parse_string(const char* str, size_t length)
 		{
 			struct scpi_token* new_tail;
 			new_tail = (struct scpi_token*)malloc(sizeof(*new_tail));
+			/** ----MODIFICATION---- */
+			if(new_tail == NULL)
+			{
+				scpi_free_tokens(head);
+				return NULL;
+			}
+			/** -------------------- */
 			new_tail->type = 1;
 			new_tail->value = str+token_start;
 			new_tail->length = i-token_start;
@@ -174,131 +288,335 @@ scpi_parse_string(const char* str, size_t length)
 	return head;
 }
 
-struct scpi_command*
-scpi_register_command(struct scpi_command* parent, scpi_command_location_t location,
-						const char* long_name,  size_t long_name_length,
-						const char* short_name, size_t short_name_length,
-						command_callback_t callback)
+/** ----MODIFICATION---- */
+/*
+ * Compare a header token with the keyword of a command.  The token
+ * matches the whole keyword or its short form, the keyword without its
+ * lower case letters, in any case.  The keyword is read from program
+ * memory, the token is never written.
+ */
+static int
+scpi_match_keyword(const struct scpi_token* token, const struct scpi_command* command)
 {
+	const char* keyword;
+	size_t i;
+	size_t j;
+	char k;
+	char c;
 	
-	struct scpi_command* current_command;
+	keyword = command->keyword;
 	
-	if(location == SCPI_CL_CHILD)
-	{
-		current_command = parent->children;
-	}
-	else
+	if(token->length < SCPI_KEYWORD_SIZE && pgm_read_byte(&keyword[token->length]) == '\0'
+		&& strncasecmp_P(token->value, keyword, token->length) == 0)
 	{
-		current_command = parent;
+		return 1;
 	}
 	
-	if(current_command == NULL)
+	j = 0;
+	for(i = 0; i < SCPI_KEYWORD_SIZE && (k = pgm_read_byte(&keyword[i])) != '\0'; i++)
 	{
-		parent->children = (struct scpi_command*)malloc(sizeof(struct scpi_command));
-		current_command = parent->children;
-	}
-	else
-	{
-		while(current_command->next != NULL)
+		if(k >= 'a' && k <= 'z')
 		{
-			current_command = current_command->next;
+			continue;
+		}
+		if(j == token->length)
+		{
+			return 0;
 		}
 		
-		current_command->next = (struct scpi_command*)malloc(sizeof(struct scpi_command));
-		current_command = current_command->next;
+		c = token->value[j++];
+		if(c >= 'a' && c <= 'z')
+		{
+			c -= 'a' - 'A';
+		}
+		if(c != k)
+		{
+			return 0;
+		}
 	}
-	
-	current_command->next = NULL;
-	current_command->children = NULL;
-	
-	current_command->long_name = long_name;
-	current_command->long_name_length = long_name_length;
-	
-	current_command->short_name = short_name;
-	current_command->short_name_length = short_name_length;
-	
-	current_command->callback = callback;
-	
-	return current_command;
+	return j == token->length;
 }
 
-struct scpi_command*
-scpi_find_command(struct scpi_parser_context* ctx,
-					const struct scpi_token* parsed_string)
+static uint8_t
+scpi_level(const struct scpi_command* command)
 {
-	struct scpi_command* root;
-	const struct scpi_token* current_token;
-	struct scpi_command* current_command;
-	
-	root = ctx->command_tree;
-	current_token = parsed_string;
-	current_command = root;
+	return pgm_read_byte(&command->level);
+}
 
+/*
+ * Resolve the header tokens starting at token against the children of
+ * parent, the top level nodes if parent is NULL.  The children follow
+ * their parent in the table, up to the next entry on the level of the
+ * parent.  Explicit matches are tried first, optional nodes are only
+ * descended into if nothing on this level matched.
+ */
+static const struct scpi_command*
+scpi_find_in_level(struct scpi_parser_context* ctx, const struct scpi_command* parent,
+					const struct scpi_token* token, const struct scpi_command** path)
+{
+	const struct scpi_command* first;
+	const struct scpi_command* end;
+	const struct scpi_command* current_command;
+	const struct scpi_command* found;
+	uint8_t level;
 	
-	while(current_token != NULL && current_token->type == 0)
+	end = ctx->command_tree + ctx->command_count;
+	if(parent == NULL)
+	{
+		first = ctx->command_tree;
+		level = 0;
+	}
+	else
 	{
+		first = parent + 1;
+		level = scpi_level(parent) + 1;
+	}
 	
-		int found_token = 0;
-		while(current_command != NULL)
+	for(current_command = first; current_command < end && scpi_level(current_command) >= level; current_command++)
+	{
+		if(scpi_level(current_command) == level && scpi_match_keyword(token, current_command))
 		{
+			if(token->next == NULL || token->next->type != 0)
+			{
+				*path = parent;
+				return current_command;
+			}
 			
-			if((current_token->length == current_command->long_name_length
-					&& !memcmp(current_token->value, current_command->long_name, current_token->length))
-				|| (current_token->length == current_command->short_name_length
-					&& !memcmp(current_token->value, current_command->short_name, current_token->length)))
+			found = scpi_find_in_level(ctx, current_command, token->next, path);
+			if(found != NULL)
 			{
-				/* We have found the token. */
-				current_token = current_token->next;
-				
-				if(current_token == NULL || current_token->type != 0)
-				{
-					return current_command;
-				}
-				else
-				{
-					found_token = 1;
-					current_command = current_command->children;
-					break;
-				}
+				return found;
 			}
-			else
+		}
+	}
+	
+	for(current_command = first; current_command < end && scpi_level(current_command) >= level; current_command++)
+	{
+		if(scpi_level(current_command) == level
+			&& (pgm_read_byte(&current_command->flags) & SCPI_CF_OPTIONAL))
+		{
+			found = scpi_find_in_level(ctx, current_command, token, path);
+			if(found != NULL)
 			{
-				current_command = current_command->next;
+				return found;
 			}
 		}
-		
-		if(!found_token)
+	}
+	
+	return NULL;
+}
+
+const struct scpi_command*
+scpi_find_command(struct scpi_parser_context* ctx,
+					const struct scpi_token* parsed_string)
+{
+	const struct scpi_command* command;
+	const struct scpi_command* path;
+	
+	if(parsed_string == NULL || parsed_string->type != 0)
+	{
+		return NULL;
+	}
+	
+	if(parsed_string->length == 0)
+	{
+		/* Leading colon, the rest is resolved from the root. */
+		if(parsed_string->next == NULL || parsed_string->next->type != 0)
 		{
 			return NULL;
 		}
+		command = scpi_find_in_level(ctx, NULL, parsed_string->next, &path);
+	}
+	else if(parsed_string->value[0] == '*')
+	{
+		/* Common commands live on the top level and keep the current path. */
+		return scpi_find_in_level(ctx, NULL, parsed_string, &path);
+	}
+	else
+	{
+		command = scpi_find_in_level(ctx, ctx->current_path, parsed_string, &path);
 	}
 	
-	return NULL;
+	if(command != NULL)
+	{
+		ctx->current_path = path;
+	}
+	
+	return command;
+}
+
+command_callback_t
+scpi_command_callback(const struct scpi_command* command)
+{
+	command_callback_t callback;
+	
+	memcpy_P(&callback, &command->callback, sizeof(callback));
+	return callback;
 }
+/** -------------------- */
 
 scpi_error_t
 scpi_execute_command(struct scpi_parser_context* ctx, const char* command_string, size_t length)
 {
-	struct scpi_command* command;
+	/** ----MODIFICATION---- */
+	const struct scpi_command* command;
+	command_callback_t callback;
+	/** -------------------- */
 	struct scpi_token* parsed_command;
 	
 	parsed_command = scpi_parse_string(command_string, length);
 	
+	/** ----MODIFICATION---- */
+	if(parsed_command == NULL && length > 0)
+	{
+		struct scpi_error error;
+		error.id = -225;
+		error.description = scpi_out_of_memory;
+		error.length = sizeof(scpi_out_of_memory) - 1;
+		scpi_queue_error(ctx, error);
+		return SCPI_COMMAND_NOT_FOUND;
+	}
+	/** -------------------- */
+	
 	command = scpi_find_command(ctx, parsed_command);
 	if(command == NULL)
 	{
+		/** ----MODIFICATION---- */
+		struct scpi_error error;
+		error.id = -113;
+		error.description = scpi_undefined_header;
+		error.length = sizeof(scpi_undefined_header) - 1;
+		scpi_queue_error(ctx, error);
+		/** -------------------- */
+		scpi_free_tokens(parsed_command);
 		return SCPI_COMMAND_NOT_FOUND;
 	}
 	
-	if(command->callback == NULL)
+	/** ----MODIFICATION---- */
+	callback = scpi_command_callback(command);
+	if(callback == NULL)
 	{
+		scpi_free_tokens(parsed_command);
 		return SCPI_NO_CALLBACK;
 	}
 	
 	
-	return command->callback(ctx, parsed_command);
+	return callback(ctx, parsed_command);
+	/** -------------------- */
+}
+
+/** ----MODIFICATION---- */
+static scpi_error_t
+scpi_run_units(struct scpi_parser_context* ctx, const char* message, size_t length)
+{
+	scpi_error_t result;
+	scpi_error_t unit_result;
+	const struct scpi_command* unit_path;
+	size_t unit_start;
+	size_t unit_end;
+	size_t i;
+	uint8_t previous_len;
+	int quoted;
+	
+	result = SCPI_SUCCESS;
+	quoted = 0;
+	unit_start = 0;
+	
+	for(i = 0; i <= length; i++)
+	{
+		if(i < length && message[i] == '"')
+		{
+			quoted = !quoted;
+		}
+		
+		if(i < length && (quoted || message[i] != ';'))
+		{
+			continue;
+		}
+		
+		/* Strip surrounding whitespace, including the CR of CR/LF hosts. */
+		unit_end = i;
+		while(unit_start < unit_end && isspace(message[unit_start]))
+		{
+			unit_start++;
+		}
+		while(unit_end > unit_start && isspace(message[unit_end-1]))
+		{
+			unit_end--;
+		}
+		
+		if(unit_end > unit_start)
+		{
+			previous_len = response_len;
+			unit_path = ctx->current_path;
+			ctx->suspend_request = 0;
+			unit_result = scpi_execute_command(ctx, message + unit_start, unit_end - unit_start);
+			
+			if(ctx->suspend_request)
+			{
+				/* Retry this unit on resume, with the path it started from. */
+				ctx->current_path = unit_path;
+				ctx->suspended_message = message + unit_start;
+				ctx->suspended_length = length - unit_start;
+				return result;
+			}
+			
+			if(unit_result != SCPI_SUCCESS && result == SCPI_SUCCESS)
+			{
+				result = unit_result;
+			}
+			
+			/* Join responses of consecutive queries with a semicolon. */
+			if(previous_len > 0 && response_len > previous_len
+				&& response_buffer[previous_len-1] == '\n')
+			{
+				response_buffer[previous_len-1] = ';';
+			}
+		}
+		
+		unit_start = i+1;
+	}
+	
+	return result;
+}
+
+scpi_error_t
+scpi_execute_message(struct scpi_parser_context* ctx, const char* message, size_t length)
+{
+	ctx->current_path = NULL;
+	ctx->suspended_message = NULL;
+	
+	return scpi_run_units(ctx, message, length);
 }
 
+void
+scpi_suspend(struct scpi_parser_context* ctx)
+{
+	ctx->suspend_request = 1;
+}
+
+uint8_t
+scpi_is_suspended(struct scpi_parser_context* ctx)
+{
+	return ctx->suspended_message != NULL;
+}
+
+scpi_error_t
+scpi_resume_message(struct scpi_parser_context* ctx)
+{
+	const char* message;
+	
+	message = ctx->suspended_message;
+	if(message == NULL)
+	{
+		return SCPI_SUCCESS;
+	}
+	
+	ctx->suspended_message = NULL;
+	return scpi_run_units(ctx, message, ctx->suspended_length);
+}
+/** -------------------- */
+
 void
 scpi_free_some_tokens(struct scpi_token* start, struct scpi_token* end)
 {
@@ -353,9 +671,7 @@ scpi_parse_numeric(const char* str, size_t length, float default_value, float mi
 			{
 				continue;
 			}
-                        else if(length-i >= 7 && str[i]   == 'D' && str[i+1] == 'E' && str[i+2] == 'F'
-                                              && str[i+3] == 'A' && str[i+4] == 'U' && str[i+5] == 'L'
-                                              && str[i+6] == 'T')
+                        else if(length-i >= 7 && !strncasecmp_P(str+i, PSTR("DEFAULT"), 7))
                         {
                                 /* The user has asked for the default value. */
                                 retval.value = default_value;
@@ -364,7 +680,7 @@ scpi_parse_numeric(const char* str, size_t length, float default_value, float mi
                                 
                                 return retval;
                         }
-                        else if(length-i >= 3 && str[i] == 'M' && str[i+1] == 'A' && str[i+2] == 'X')
+                        else if(length-i >= 3 && !strncasecmp_P(str+i, PSTR("MAX"), 3))
                         {
                                 /* The user has asked for the maximum value. */
                                 retval.value = max_value;
@@ -372,7 +688,7 @@ scpi_parse_numeric(const char* str, size_t length, float default_value, float mi
                                 retval.length = 0;
                                 return retval;
                         }
-                        else if(length-i >= 3 && str[i] == 'M' && str[i+1] == 'I' && str[i+2] == 'N')
+                        else if(length-i >= 3 && !strncasecmp_P(str+i, PSTR("MIN"), 3))
                         {
                                 /* The user has asked for the minimum value. */
                                 retval.value = min_value;
@@ -692,59 +1008,140 @@ scpi_parse_numeric(const char* str, size_t length, float default_value, float mi
 	return retval;
 }
 
-void
-scpi_queue_error(struct scpi_parser_context* ctx, struct scpi_error error)
+/** ----MODIFICATION---- */
+uint8_t
+scpi_parse_fixed(const char* str, size_t length, int32_t scale, int32_t* value)
 {
-	struct scpi_error* new_error;
+	size_t i;
+	uint8_t negative;
+	uint8_t digits;
+	uint8_t fraction_digits;
+	uint32_t integer;
+	uint32_t fraction;
+	uint32_t denominator;
+	uint32_t result;
 	
-	new_error = (struct scpi_error*)malloc(sizeof(struct scpi_error));
-	new_error->id = error.id;
-	new_error->description = error.description;
-	new_error->length = error.length;
+	i = 0;
+	negative = 0;
+	digits = 0;
+	fraction_digits = 0;
+	integer = 0;
+	fraction = 0;
+	denominator = 1;
 	
-	new_error->next = NULL;
+	while(i < length && isspace(str[i]))
+	{
+		i++;
+	}
 	
-	if(ctx->error_queue_head != NULL)
+	if(i < length && (str[i] == '+' || str[i] == '-'))
 	{
-		ctx->error_queue_tail->next = new_error;
+		negative = (str[i] == '-');
+		i++;
 	}
-	else
+	
+	for(; i < length && isdigit(str[i]); i++, digits++)
+	{
+		if(integer > (UINT32_MAX - 9) / 10)
+		{
+			return 0;
+		}
+		integer = 10*integer + (uint8_t)(str[i] - '0');
+	}
+	
+	if(i < length && str[i] == '.')
+	{
+		for(i++; i < length && isdigit(str[i]); i++, digits++)
+		{
+			if(fraction_digits < 6)
+			{
+				fraction = 10*fraction + (uint8_t)(str[i] - '0');
+				denominator *= 10;
+				fraction_digits++;
+			}
+		}
+	}
+	
+	while(i < length && isspace(str[i]))
 	{
-		ctx->error_queue_head = new_error;
+		i++;
 	}
 	
-	ctx->error_queue_tail = new_error;
+	if(digits == 0 || i != length)
+	{
+		return 0;
+	}
+	
+	if(integer > (uint32_t)INT32_MAX / (uint32_t)scale)
+	{
+		return 0;
+	}
+	
+	/* fraction < 10^6, so fraction*scale fits for any scale below 4294. */
+	result = integer * (uint32_t)scale + (fraction * (uint32_t)scale + denominator/2) / denominator;
+	if(result > (uint32_t)INT32_MAX)
+	{
+		return 0;
+	}
+	
+	*value = negative ? -(int32_t)result : (int32_t)result;
+	return 1;
 }
 
-struct scpi_error*
-scpi_pop_error(struct scpi_parser_context* ctx)
+void
+scpi_queue_error(struct scpi_parser_context* ctx, struct scpi_error error)
 {
-	if(ctx->error_queue_head == NULL)
+	uint8_t tail;
+	
+	if(ctx->error_queue_count == SCPI_ERROR_QUEUE_LEN)
 	{
-		struct scpi_error* success;
-		
-		success = (struct scpi_error*)malloc(sizeof(struct scpi_error));
-		success->id = 0;
-		success->description = "No error";
-		success->length = 8;
-		
-		return success;
+		/* Queue is full, the newest entry turns into an overflow marker. */
+		tail = (ctx->error_queue_head + SCPI_ERROR_QUEUE_LEN - 1) % SCPI_ERROR_QUEUE_LEN;
+		ctx->error_queue[tail].id = -350;
+		ctx->error_queue[tail].description = scpi_queue_overflow;
+		ctx->error_queue[tail].length = sizeof(scpi_queue_overflow) - 1;
+		return;
 	}
-	else
-	{
-		struct scpi_error* retval;
+	
+	tail = (ctx->error_queue_head + ctx->error_queue_count) % SCPI_ERROR_QUEUE_LEN;
+	ctx->error_queue[tail] = error;
+	ctx->error_queue_count++;
+}
 
-		retval = ctx->error_queue_head;
-		ctx->error_queue_head = retval->next;
-		
-		if(ctx->error_queue_head == NULL)
+struct scpi_error
+scpi_pop_error(struct scpi_parser_context* ctx)
 {
-			ctx->error_queue_tail = NULL;
-		}
+	struct scpi_error retval;
+	
+	if(ctx->error_queue_count == 0)
+	{
+		retval.id = 0;
+		retval.description = scpi_no_error;
+		retval.length = sizeof(scpi_no_error) - 1;
 		
 		return retval;
 	}
+	
+	retval = ctx->error_queue[ctx->error_queue_head];
+	ctx->error_queue_head = (ctx->error_queue_head + 1) % SCPI_ERROR_QUEUE_LEN;
+	ctx->error_queue_count--;
+	
+	return retval;
+}
+
+uint8_t
+scpi_error_count(struct scpi_parser_context* ctx)
+{
+	return ctx->error_queue_count;
+}
+
+void
+scpi_clear_errors(struct scpi_parser_context* ctx)
+{
+	ctx->error_queue_head = 0;
+	ctx->error_queue_count = 0;
 }
+/** -------------------- */
 
 #ifdef __cplusplus
 
@@ -23,7 +23,24 @@ SOFTWARE.
 #ifndef __SCPIPARSER_H
 #define __SCPIPARSER_H
 
-#include <Arduino.h>
+/** ----MODIFICATION---- */
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#else
+/* Builds for other targets keep the flash strings in RAM */
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define memcpy_P memcpy
+#define strncasecmp_P strncasecmp
+#endif
+/** -------------------- */
 
 #ifdef __cplusplus
 
@@ -34,6 +51,41 @@ SOFTWARE.
 #define BUF_LEN 128
 extern char response_buffer[BUF_LEN];
 extern uint8_t response_len;
+
+/*
+ * Response formatting. All functions append to response_buffer, output
+ * that does not fit into the remaining buffer space is truncated. The
+ * last byte is kept for the '\n' terminator, a truncated response still
+ * ends the line and the host does not wait for it. They replace
+ * snprintf, so the float printf library is not linked.
+ */
+
+/**
+ * Append a single character to response_buffer.
+ */
+void
+scpi_putc(char c);
+
+/**
+ * Append a string stored in program memory to response_buffer.
+ */
+void
+scpi_puts_P(const char* str);
+
+/**
+ * Append a signed decimal integer to response_buffer.
+ */
+void
+scpi_print_int(int32_t value);
+
+/**
+ * Append the fixed point number value/scale to response_buffer, rounded
+ * to the given number of decimals.
+ *
+ * For example, value -200 with scale 16 and 2 decimals => -12.50
+ */
+void
+scpi_print_fixed(int32_t value, int32_t scale, uint8_t decimals);
 /** -------------------- */
 
 typedef enum scpi_error_codes
@@ -43,11 +95,10 @@ typedef enum scpi_error_codes
 	SCPI_NO_CALLBACK		= -2
 } scpi_error_t;
 
-typedef enum scpi_command_location
-{
-	SCPI_CL_SAMELEVEL,
-	SCPI_CL_CHILD
-} scpi_command_location_t;
+/** ----MODIFICATION---- */
+/* Command flags */
+#define SCPI_CF_OPTIONAL	0x01	/* node may be omitted in the header, e.g. [:MOTor] */
+/** -------------------- */
 
 struct scpi_token;
 struct scpi_parser_context;
@@ -66,35 +117,66 @@ struct scpi_token
 	struct scpi_token*	next;
 };
 
+/** ----MODIFICATION---- */
+/* Capacity of the error queue, the last slot is reserved for -350 Queue overflow */
+#define SCPI_ERROR_QUEUE_LEN 8
+/** -------------------- */
+
 struct scpi_error
 {
 	int id;
-	const char* description;
+	const char* description;	/* points to program memory (PROGMEM) */
 	size_t length;
-	
-	struct scpi_error* next;
 };
 
 struct scpi_parser_context
 {
-	struct scpi_command* command_tree;
-	struct scpi_error*   error_queue_head;
-	struct scpi_error*   error_queue_tail;
+	/** ----MODIFICATION---- */
+	const struct scpi_command* command_tree;
+	/** -------------------- */
+	
+	/** ----MODIFICATION---- */
+	/* Fixed size error ring buffer, no heap allocation */
+	struct scpi_error    error_queue[SCPI_ERROR_QUEUE_LEN];
+	uint8_t              error_queue_head;
+	uint8_t              error_queue_count;
+	/** -------------------- */
+	
+	/** ----MODIFICATION---- */
+	/* Number of entries of command_tree, a table in program memory */
+	uint8_t              command_count;
+	
+	/* Node that relative headers of a compound message are resolved
+	 * against, NULL for the root */
+	const struct scpi_command* current_path;
+	
+	/* Rest of a message suspended by a callback, see scpi_suspend() */
+	const char*          suspended_message;
+	size_t               suspended_length;
+	uint8_t              suspend_request;
+	/** -------------------- */
 };
 
+/** ----MODIFICATION---- */
+/* Longest keyword, including the terminating '\0' */
+#define SCPI_KEYWORD_SIZE 14
+
+/*
+ * One entry of the command table, see scpi_init().  The table lives in
+ * program memory, so the command tree costs no RAM.
+ */
 struct scpi_command
 {
-	const char*	long_name;
-	size_t	long_name_length;
+	uint8_t	level;		/* depth below the root, 0 for top level nodes */
+	uint8_t	flags;		/* SCPI_CF_* */
 	
-	const char*	short_name;
-	size_t	short_name_length;
-
-	struct scpi_command* next;
-	struct scpi_command* children;
+	/* Keyword in SCPI notation, e.g. "POSition?".  The upper case
+	 * letters and the other characters form the short form "POS?". */
+	char	keyword[SCPI_KEYWORD_SIZE];
 	
 	command_callback_t callback;
 };
+/** -------------------- */
 
 struct scpi_numeric
 {
@@ -103,79 +185,96 @@ struct scpi_numeric
 	size_t length;
 };
 
+/** ----MODIFICATION---- */
 /**
  * Initialise an SCPI parser.
  *
- * @param ctx	A pointer to the struct scpi_parser_context to initialise.
+ * The command tree is a constant table in program memory, listed depth
+ * first: every node is followed by its children, one level deeper, up
+ * to the next entry on its own level or above.  For example
+ *
+ *		{0, 0,                "MOTor",     NULL},
+ *		{1, 0,                "MOVe",      NULL},
+ *		{2, 0,                "ABSolute",  move_absolute},
+ *		{1, 0,                "POSition?", get_position},
+ *		{0, 0,                "*IDN?",     identify},
+ *
+ * gives :MOTor:MOVe:ABSolute, :MOTor:POSition? and *IDN?.  The table
+ * must list the built-in commands scpi_system_error (SYSTem:ERRor? and
+ * SYSTem:ERRor:NEXT?), scpi_system_error_count (SYSTem:ERRor:COUNt?)
+ * and scpi_clear_status (*CLS).
+ *
+ * Keywords are given in the usual SCPI notation, the short form is the
+ * keyword without its lower case letters.  An alias with a different
+ * short form is a second entry with the same callback.
+ *
+ * @param ctx		A pointer to the struct scpi_parser_context to initialise.
+ * @param commands	The command table, in program memory.
+ * @param count		The number of entries in commands.
  */
 void
-scpi_init(struct scpi_parser_context* ctx);
+scpi_init(struct scpi_parser_context* ctx, const struct scpi_command* commands, uint8_t count);
+
+scpi_error_t
+scpi_system_error(struct scpi_parser_context* ctx, struct scpi_token* command);
+
+scpi_error_t
+scpi_system_error_count(struct scpi_parser_context* ctx, struct scpi_token* command);
+
+scpi_error_t
+scpi_clear_status(struct scpi_parser_context* ctx, struct scpi_token* command);
+/** -------------------- */
 
 /**
  * Convert an SCPI command into a list of tokens.
  *
+ * The string is left untouched, scpi_find_command compares the header
+ * case-insensitively.
+ *
  * @param str		A pointer to the string to be parsed.
  * @param length	The length of the string to be parsed.
  *
- * @return A linked list of tokens, pointing into the original string.
+ * @return A linked list of tokens, pointing into the original string,
+ *         or NULL if the heap ran out.
  */
 struct scpi_token*
 scpi_parse_string(const char* str, size_t length);
 
 /**
- * Add a command to a tree.
- *
- * The scpi_register_command function adds a command to the command tree.
- * Each command has a short name, a long name, and optionally a callback.
- *
- * The names are determined by the SCPI standard.  For a single-word name,
- * the long name is equal to the fill name.  For a multi-word name, the
- * long name is equal to the first letter of each word, with the final
- * word spelt out in full.
- *
- * The short name is equal to the first four letters of the long name.
- * If the final letters is a vowel, then it is dropped.
- *
- * For example,
- *
- *		Radial Velocity	-> RVELOCITY	-> RVEL
- *		Sweep			-> SWEEP		-> SWE
- * 
- * @param parent	The command to which the new command is to be attached.
- *
- * @param location	Where to register the command.  If SCPI_CL_SAMELEVEL,
- * 					then the command will be placed at the same level as
- *					the parent, however the value SCPI_CL_CHILD will cause
- *					the new command to be registered at the level beneath
- *					the parent.
+ * Find a command structure in a tree.
  *
- * @param long_name			The long form of the command.
- * @param long_name_length	The length of long_name.
- * @param short_name		The short form of the command.
- * @param short_name_length	The length of short_name.
+ * Headers with a leading colon are resolved from the root of the tree,
+ * common commands (*XXX) from the top level.  Any other header is
+ * resolved relative to the node of the previously found command, as
+ * required for compound messages.  The relative path is updated on
+ * every successful lookup except for common commands.
  *
- * @param callback	A function to be called when the command is executed.
- *
- * @return A pointer to the command structure inserted.
- */
-struct scpi_command*
-scpi_register_command(struct scpi_command* parent, scpi_command_location_t location,
-						const char* long_name,  size_t long_name_length,
-						const char* short_name, size_t short_name_length,
-						command_callback_t callback);
-						
-/**
- * Find a command structure in a tree.
+ * A node flagged SCPI_CF_OPTIONAL may be left out of a header, e.g.
+ * with MOTor optional, :POSition? resolves to :MOTor:POSition?.
+ * Explicitly given nodes always take precedence over optional ones.
  *
  * @param ctx			The parser context as created by scpi_init.
  * @param parsed_string The linked-list of tokens produced by the parser.
  *
- * @return The command object referred to by the token list.
+ * @return The table entry referred to by the token list, in program
+ *         memory, or NULL.
  */
-struct scpi_command*
+/** ----MODIFICATION---- */
+const struct scpi_command*
 scpi_find_command(struct scpi_parser_context* ctx,
 					const struct scpi_token* parsed_string);
 
+/**
+ * Read the callback of a table entry from program memory.
+ *
+ * @param command	An entry returned by scpi_find_command.
+ *
+ * @return The callback, NULL for nodes without one.
+ */
+command_callback_t
+scpi_command_callback(const struct scpi_command* command);
+/** -------------------- */
+
 					
 /**
  * Execute an SCPI command string.
@@ -189,6 +288,66 @@ scpi_find_command(struct scpi_parser_context* ctx,
 scpi_error_t
 scpi_execute_command(struct scpi_parser_context* ctx, const char* command_string, size_t length);
 
+/**
+ * Execute a complete SCPI program message.
+ *
+ * The message is split into message units at every semicolon outside
+ * of quoted strings and the units are executed in order.  The first
+ * unit is resolved from the root of the command tree, following units
+ * relative to the path of their predecessor, e.g.
+ *
+ *		:MOT:SP 400;ACC 200;:MOT:MOV:ABS 12.5
+ *
+ * Responses of the single units are joined with a semicolon in
+ * response_buffer and terminated by a single line feed.
+ *
+ * @param ctx		The SCPI parser context.
+ * @param message	The program message without its terminator.
+ * @param length	The length of the message.
+ *
+ * @return The first error code returned by one of the units.
+ */
+scpi_error_t
+scpi_execute_message(struct scpi_parser_context* ctx, const char* message, size_t length);
+
+/**
+ * Suspend the message that is currently executed.
+ *
+ * Called by a callback that cannot complete yet, e.g. *WAI while the
+ * motor is moving.  scpi_execute_message returns after the callback and
+ * keeps a reference to the rest of the message, starting with the
+ * calling unit.  The message buffer must stay untouched until the
+ * message is resumed.
+ *
+ * @param ctx	The SCPI parser context.
+ */
+void
+scpi_suspend(struct scpi_parser_context* ctx);
+
+/**
+ * Check for a suspended message.
+ *
+ * @param ctx	The SCPI parser context.
+ *
+ * @return 1 if a message is suspended, 0 otherwise.
+ */
+uint8_t
+scpi_is_suspended(struct scpi_parser_context* ctx);
+
+/**
+ * Continue a suspended message.
+ *
+ * The suspending unit is executed again, with the same relative path,
+ * and may suspend the message once more.  Responses keep accumulating
+ * in response_buffer.
+ *
+ * @param ctx	The SCPI parser context.
+ *
+ * @return The first error code returned by one of the units.
+ */
+scpi_error_t
+scpi_resume_message(struct scpi_parser_context* ctx);
+
 /**
  * Free a token list.
  *
@@ -228,11 +387,42 @@ scpi_free_some_tokens(struct scpi_token* start, struct scpi_token* end);
 struct scpi_numeric
 scpi_parse_numeric(const char* str, size_t length, float default_value, float min_value, float max_value);
 
+/** ----MODIFICATION---- */
+/**
+ * Parse a plain decimal number into a fixed point integer.
+ *
+ * The scpi_parse_fixed function is the fast path for numeric arguments.
+ * It accepts an optional sign, digits and an optional decimal point
+ * surrounded by whitespace, and converts the number exactly to
+ * round(number * scale) using integer arithmetic only.  Fraction digits
+ * beyond the sixth are ignored.
+ *
+ * Anything else (exponents, units, DEFAULT/MIN/MAX) is rejected, the
+ * caller should then fall back to scpi_parse_numeric.
+ *
+ * For example, "-12.5" with scale 16 => -200
+ *
+ * @param str		The string to parse.
+ * @param length	The length of the string to parse.
+ * @param scale		Number of fixed point units per integer unit.
+ * @param value		Receives the converted value.
+ *
+ * @return 1 on success, 0 if the string is not a plain decimal number
+ *			or does not fit into value.
+ */
+uint8_t
+scpi_parse_fixed(const char* str, size_t length, int32_t scale, int32_t* value);
+/** -------------------- */
+
 /**
  * Add an error to the queue.
  *
+ * If the queue is full, the most recent error is replaced by
+ * -350 "Queue overflow" and the new error is discarded.
+ *
  * @param ctx  	The parser context to which the error is associated.
- * @param error	The error object that is to be queued.
+ * @param error	The error object that is to be queued.  The description
+ *				must be stored in program memory.
  */
 void
 scpi_queue_error(struct scpi_parser_context* ctx, struct scpi_error error);
@@ -242,11 +432,30 @@ scpi_queue_error(struct scpi_parser_context* ctx, struct scpi_error error);
  *
  * @param ctx	The parser context from which the error is to be popped.
  *
- * @return The oldest error object in the queue.
+ * @return The oldest error object in the queue, or 0 "No error" if
+ *			the queue is empty.
  */
-struct scpi_error*
+struct scpi_error
 scpi_pop_error(struct scpi_parser_context* ctx);
 
+/**
+ * Get the number of errors in the queue.
+ *
+ * @param ctx	The parser context.
+ *
+ * @return The number of queued errors.
+ */
+uint8_t
+scpi_error_count(struct scpi_parser_context* ctx);
+
+/**
+ * Remove all errors from the queue, as done by *CLS.
+ *
+ * @param ctx	The parser context.
+ */
+void
+scpi_clear_errors(struct scpi_parser_context* ctx);
+
 #ifdef __cplusplus
   }
 #endif
@@ -6,20 +6,19 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <util/delay.h>
 #include <math.h>
 
 #include "A4988.h"
+#include "trace.h"
+#include "profile.h"
+#include "telemetry.h"
 
-/*
-#define A4988_PORT PORTB
-#define A4988_DDR DDRB
-
-#define DIR PB0
-#define STEP PB1
-#define MS1 PB2
-#define MS2 PB4
-#define MS3 PB3
-*/
+/* the ISR holds STEP high for at least 4 µs and runs at most at F_CPU/1024 */
+#if DRIVER_STEP_PULSE_NS > 4000 || F_CPU / 1024 > DRIVER_STEP_RATE_MAX
+#error "step timing of the ISR out of the driver specs"
+#endif
 
 volatile microstep_t MICROSTEPS = HALF;
 volatile motor_state_t STATE;
@@ -40,8 +39,20 @@ volatile uint32_t steps_to_move;
 volatile uint32_t steps_to_accelerate;
 volatile uint32_t steps_to_decelerate;
 
-volatile int32_t MICROSTEPS_CNT = 0;	//integer value of current position in 1/16 steps (minimum microstepping)
+volatile int32_t softlimit_pos = INT32_MAX;	// softlimits in position counts
+volatile int32_t softlimit_neg = INT32_MIN;
+volatile int32_t limit_cnt = INT32_MAX;		// softlimit in the direction of the current move
+volatile int32_t follow_cnt;			// trajectory target in position counts
+static volatile uint8_t follow_stopping;	// soft_stop() brakes the trajectory
+static float follow_rate;				// counts per tick towards the target
+static int32_t follow_origin;			// target when braking started
+static float follow_travel;				// counts braked since then
+
+static uint8_t trace_countdown;		// steps until the next trace sample
+
+volatile int32_t MICROSTEPS_CNT = 0;	//integer value of current position in 1/POSITION_SCALE steps (minimum microstepping)
 extern volatile uint8_t UPDATE_FLAG;
+extern volatile uint8_t MOTION_FLAG;
 
 
 /*
@@ -79,7 +90,7 @@ void halt(){
 /*
  * Calculate the number of steps for acceleration and decceleration ramps. steps in units of current microstepping
  */
-void calculate_steps(uint32_t steps){   
+static void split_ramp(uint32_t steps, uint32_t* accelerate, uint32_t* decelerate){
     // calculate acceleration step candidates
     uint32_t acc_steps = (uint32_t)(1.0*speed_limit * speed_limit * MICROSTEPS/ (2.0*acc));
     
@@ -88,36 +99,69 @@ void calculate_steps(uint32_t steps){
     
     // remaining steps will be moving with constant top speed
     if((acc_steps + dec_steps) <= steps){
-        steps_to_accelerate = acc_steps;
-        steps_to_decelerate = dec_steps;
-        steps_to_move = steps - (acc_steps + dec_steps);
+        *accelerate = acc_steps;
+        *decelerate = dec_steps;
     }
     
     // if no steps would remain, calculate new ramp with lower top speed
     else{
-        steps_to_move = 0;
-        steps_to_accelerate = (uint32_t)(1.0*steps / (1.0 + (1.0*acc/dec)));
-        steps_to_decelerate = steps - steps_to_accelerate;
+        *accelerate = (uint32_t)(1.0*steps / (1.0 + (1.0*acc/dec)));
+        *decelerate = steps - *accelerate;
     }
+}
+
+void calculate_steps(uint32_t steps){   
+    uint32_t accelerate;
+    uint32_t decelerate;
+    
+    split_ramp(steps, &accelerate, &decelerate);
     
+    steps_to_accelerate = accelerate;
+    steps_to_decelerate = decelerate;
+    steps_to_move = steps - (accelerate + decelerate);
     total_steps = steps;
     step = 0;
     speed = 0.0;
 }
 
-/* 
- * Generate accelerating pulses with Timer1.
- * Executing the ISR on a Controller with F_CPU of 16MHz will result in a 100µs pulse
- * during acceleration and deceleration. This is mainly caused by the calculation of the
- * new timer value. For the constant speed phase the pulse duration is much shorter (~4-5µs)
- * but well within specs of the A4988 controller (pulse duration > 1µs).
+/*
+ * Trajectory mode: one step towards follow_cnt, DIR is already set by
+ * follow_target(). Runs with Timer1 at F_CPU/64.
  */
-ISR(TIMER1_COMPA_vect){
+static inline void follow_step(){
+    uint8_t increment = POSITION_SCALE/MICROSTEPS;
+    int32_t diff = follow_cnt - MICROSTEPS_CNT;
+    
+    if((DIRECTION == CW) ? (diff < increment) : (diff > -(int16_t)increment)) return;
+    
+    PIN_HIGH(PIN_STEP);
+    MICROSTEPS_CNT = (DIRECTION == CW) ? MICROSTEPS_CNT + increment : MICROSTEPS_CNT - increment;
+    _delay_us(DRIVER_STEP_PULSE_NS / 1000.0);
+    PIN_LOW(PIN_STEP);
+}
+
+/*
+ * One step of the ramp generator, run by the Timer1 ISR and for the
+ * first step of start_plan().
+ */
+static inline void ramp_step(){
+    uint8_t phase;
+    
     // generate rising edge for the pulse on the step pin
-    PORTB |= _BV(STEP);
+    PIN_HIGH(PIN_STEP);
     
-    if(step < steps_to_accelerate){
+    if(step + 1 >= total_steps){
+		// last step, also ends a ramp of no steps at all (soft_stop() at
+		// low speed). Halt Timer1 and update motor state
+        phase = TRACE_LAST_STEP;
+        halt();
+        STATE = STOPPED;
+        MOTION_FLAG = 1;
+    }
+    
+    else if(step < steps_to_accelerate){
         // acceleration phase
+        phase = TRACE_ACCELERATE;
         speed = sqrt(2.0*(step+1)*acc/1.0*MICROSTEPS);/// MICROSTEPS);
         OCR1A = (uint16_t)(F_CPU/(1024*speed) - 1);
     }
@@ -126,27 +170,66 @@ ISR(TIMER1_COMPA_vect){
         // moving with constant top speed
         // helper variable for top speed printing
         speedprint = speed;
+        phase = TRACE_CONSTANT;
     }
     
-    else if((step > (steps_to_accelerate + steps_to_move)) && (step < total_steps -1)){
+    else{
         // deceleration phase. true until second to last step.
+        phase = TRACE_DECELERATE;
         speed = sqrt(2.0*(total_steps - (step+1))*dec/1.0*MICROSTEPS);/// MICROSTEPS);
         OCR1A = (uint16_t)(F_CPU/(1024*speed) - 1);
     }
     
-    else{
-		// last step. Halt Timer1 and update motor state
-        halt();
-        STATE = STOPPED;
+    if(trace_decimation != 0 && --trace_countdown == 0){
+        trace_countdown = trace_decimation;
+        trace_sample((uint16_t)step, (phase == TRACE_LAST_STEP) ? 0 : OCR1A, phase);
     }
     
     step++;
     
-    uint8_t increment = 16/MICROSTEPS;
+    uint8_t increment = POSITION_SCALE/MICROSTEPS;
     MICROSTEPS_CNT = (DIRECTION == CW) ? MICROSTEPS_CNT + increment : MICROSTEPS_CNT - increment;
     
+    // last line of defence, the planner normally ends the move at the softlimit
+    if((DIRECTION == CW) ? (MICROSTEPS_CNT >= limit_cnt) : (MICROSTEPS_CNT <= limit_cnt)){
+        if(STATE == MOVING){
+            halt();
+            STATE = STOPPED;
+            MOTION_FLAG = 1;
+        }
+    }
+    
     // generate falling edge for the pulse on the step pin
-    PORTB &= ~_BV(STEP);
+    PIN_LOW(PIN_STEP);
+}
+
+/* 
+ * Generate accelerating pulses with Timer1.
+ * Executing the ISR on a Controller with F_CPU of 16MHz will result in a 100µs pulse
+ * during acceleration and deceleration. This is mainly caused by the calculation of the
+ * new timer value. For the constant speed phase the pulse duration is much shorter (~4-5µs)
+ * but well within specs of the supported drivers (pulse duration > 1.9µs for the DRV8825, checked above).
+ */
+ISR(TIMER1_COMPA_vect){
+    PROFILE_BEGIN(profile_start);
+    
+    if(RUN == TRAJECTORY){
+        follow_step();
+    }
+    else{
+        ramp_step();
+    }
+    
+    PROFILE_END(PROFILE_STEP_ISR, profile_start);
+}
+
+/*
+ * Number of steps needed to stop from the current speed at the
+ * configured deceleration, the inverse of the deceleration ramp in the
+ * ISR.
+ */
+static uint32_t stopping_steps(){
+	return (uint32_t)(speed * speed / (2.0*dec*MICROSTEPS));
 }
 
 /*
@@ -154,8 +237,19 @@ ISR(TIMER1_COMPA_vect){
  * moving to another position while motor is still busy.
  */
 void soft_stop(){
+	if(RUN == TRAJECTORY){
+		// follow_brake() ramps down from the velocity of the last tick
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+			if(STATE == MOVING && !follow_stopping){
+				follow_origin = follow_cnt;
+				follow_travel = 0.0;
+				follow_stopping = 1;
+			}
+		}
+		return;
+	}
 	if(STATE == MOVING){
-		steps_to_decelerate = (uint16_t)(speed * speed / (2.0*dec));
+		steps_to_decelerate = stopping_steps();
 		steps_to_move = 0;
 		steps_to_accelerate = 0;
 		total_steps = steps_to_decelerate;
@@ -163,58 +257,120 @@ void soft_stop(){
 	}
 }
 
+/*
+ * Shorten the running move so it ends after at most steps more steps,
+ * braking within them. If the current speed does not allow that, the
+ * ramp is cut short and the ISR halts the motor at the softlimit. Call
+ * with interrupts disabled.
+ */
+static void limit_remaining_steps(uint32_t steps){
+	uint32_t braking;
+	
+	if(total_steps - step <= steps) return;
+	
+	if(steps == 0){
+		halt();
+		STATE = STOPPED;
+		MOTION_FLAG = 1;
+		return;
+	}
+	
+	braking = stopping_steps();
+	if(braking > steps){
+		braking = steps;
+	}
+	
+	steps_to_accelerate = 0;
+	steps_to_move = steps - braking;
+	steps_to_decelerate = braking;
+	total_steps = steps;
+	step = 0;
+}
+
+/*
+ * Make the running move respect the current softlimits and position
+ * counter, called whenever one of them changes. Call with interrupts
+ * disabled.
+ */
+static void enforce_softlimits(){
+	int64_t room;
+	
+	// follow_target() holds a trajectory within the softlimits
+	if(STATE != MOVING || RUN == TRAJECTORY) return;
+	
+	if(DIRECTION == CW){
+		limit_cnt = softlimit_pos;
+		room = (int64_t)limit_cnt - MICROSTEPS_CNT;
+	}
+	else{
+		limit_cnt = softlimit_neg;
+		room = (int64_t)MICROSTEPS_CNT - limit_cnt;
+	}
+	
+	if(room < 0){
+		room = 0;
+	}
+	room = room * MICROSTEPS / POSITION_SCALE;
+	
+	limit_remaining_steps((room > UINT32_MAX) ? UINT32_MAX : (uint32_t)room);
+}
+
+/*
+ * The MS pin levels of each mode come from the driver traits, modes
+ * without a DRIVER_MS_ define are not compiled in.
+ */
 void set_microstepping(microstep_t stepping){
+	uint8_t ms;
+	
 	switch(stepping){
-		case FULL:
-			PORTB &= ~_BV(MS3);
-			PORTD &= ~(_BV(MS1) | _BV(MS2));
-            break;
-			
-		case HALF:
-            PORTB &= ~_BV(MS3);
-			PORTD &= ~_BV(MS2);
-			PORTD |= _BV(MS1);
-			break;
-			
-		case QUARTER:
-			PORTB &= ~_BV(MS3);
-			PORTD &= ~_BV(MS1);
-			PORTD |= _BV(MS2);
-			break;
-			
-		case EIGHTH:
-			PORTB &= ~_BV(MS3);
-			PORTD |= (_BV(MS1) | _BV(MS2));
-			break;
-			
-		case SIXTEENTH:
-            PORTB |= _BV(MS3);
-			PORTD |= (_BV(MS1) | _BV(MS2));
-			break;
-			
+#ifdef DRIVER_MS_FULL
+		case FULL: ms = DRIVER_MS_FULL; break;
+#endif
+#ifdef DRIVER_MS_HALF
+		case HALF: ms = DRIVER_MS_HALF; break;
+#endif
+#ifdef DRIVER_MS_QUARTER
+		case QUARTER: ms = DRIVER_MS_QUARTER; break;
+#endif
+#ifdef DRIVER_MS_EIGHTH
+		case EIGHTH: ms = DRIVER_MS_EIGHTH; break;
+#endif
+#ifdef DRIVER_MS_SIXTEENTH
+		case SIXTEENTH: ms = DRIVER_MS_SIXTEENTH; break;
+#endif
+#ifdef DRIVER_MS_THIRTYSECOND
+		case THIRTYSECOND: ms = DRIVER_MS_THIRTYSECOND; break;
+#endif
+#ifdef DRIVER_MS_SIXTYFOURTH
+		case SIXTYFOURTH: ms = DRIVER_MS_SIXTYFOURTH; break;
+#endif
 		default: return;
 	}
+	
+	PIN_WRITE(PIN_MS1, ms & MS_PIN1);
+	PIN_WRITE(PIN_MS2, ms & MS_PIN2);
+	PIN_WRITE(PIN_MS3, ms & MS_PIN3);
 	MICROSTEPS = stepping;
 }
 
-ISR(PCINT2_vect){
+ISR(PIN_PCINT_vect(PIN_SW_NEG)){
     UPDATE_FLAG = 1;
 }
 
 /** This function will be called each time a limit switch changes its state */
 void update_state(){
-	/* ToDo: read switches. The input turns low when activated */
-	uint8_t neg = (PIND & (1 << SW_NEG));
-	uint8_t pos = (PIND & (1 << SW_POS));
-	/* ----- */
+	/* the switches are active low, they pull their input low when activated */
+	uint8_t neg_active = !PIN_READ(PIN_SW_NEG);
+	uint8_t pos_active = !PIN_READ(PIN_SW_POS);
     
     
     /* high limit switch activated */
-	if(neg && !pos){
+	if(pos_active && !neg_active){
         halt();
         STATE = STOPPED;
         SW_STATE = LIMIT_POS;
-        PORTB |= ( 1 << PB5 );
+        MOTION_FLAG = 1;
+        PIN_HIGH(PIN_LED);
         
         /* slowly move out of the switch during homerun 
         if (RUN == HOME_RUN_POS){
@@ -224,11 +380,12 @@ void update_state(){
     }
     
     /* low limit switch activated */
-    else if(!neg && pos){
+    else if(neg_active && !pos_active){
         halt();
         STATE = STOPPED;
         SW_STATE = LIMIT_NEG;
-        PORTB |= ( 1 << PB5 );
+        MOTION_FLAG = 1;
+        PIN_HIGH(PIN_LED);
         
         /* slowly move out of the switch during homerun 
         if (RUN == HOME_RUN_NEG){
@@ -238,16 +395,17 @@ void update_state(){
     }
     
     /* both limit switches activated */
-    else if(!neg && !pos){
+    else if(neg_active && pos_active){
         halt();
         STATE = STOPPED;
         SW_STATE = FAULT;
-        PORTB |= ( 1 << PB5 );
+        MOTION_FLAG = 1;
+        PIN_HIGH(PIN_LED);
     }
 
     else{
         SW_STATE = FREE;
-        PORTB &= ~( 1 << PB5 );
+        PIN_LOW(PIN_LED);
         
         /* home run complete after limit switch is released 
         if (RUN == RETURN_FROM_POS || RUN == RETURN_FROM_NEG){
@@ -263,31 +421,287 @@ void update_state(){
  * Return the current position in full steps
  */
 float get_position(){
-	return (float)(MICROSTEPS_CNT/16.0);
+	return (float)(get_position_cnt()/(float)POSITION_SCALE);
 }
 
-
-void move_relative(float distance){
-	uint32_t dist;
+int32_t get_position_cnt(){
+	int32_t cnt;
 	
-	if(distance >= 0.0){
-        if(SW_STATE == FAULT || SW_STATE == LIMIT_POS || STATE == MOVING) return;
-        dist = (uint32_t)(distance * MICROSTEPS);
-        PORTB |= _BV(DIR);
-        DIRECTION = CW;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		cnt = MICROSTEPS_CNT;
+	}
+	return cnt;
+}
+
+
+/*
+ * Start a move of dist microsteps in the given direction. No checks.
+ */
+static void start_move(uint32_t dist, motor_direction_t direction){
+    if(direction == CW){
+        PIN_HIGH(PIN_DIR);
     }
     else{
-        if(SW_STATE == FAULT || SW_STATE == LIMIT_NEG || STATE == MOVING) return;
-        dist = (uint32_t)(-1.0*distance * MICROSTEPS);
-        PORTB &= ~_BV(DIR);
-        DIRECTION = CCW;
+        PIN_LOW(PIN_DIR);
     }
+    DIRECTION = direction;
+    limit_cnt = (direction == CW) ? softlimit_pos : softlimit_neg;
+    if(RUN == TRAJECTORY) RUN = NORMAL;
 	
+    trace_clear();
+    trace_countdown = 1;	// the first step is always recorded
     calculate_steps(dist);
     run();
     STATE = MOVING;
 }
 
+/*
+ * Microsteps of the current mode in a distance of counts position
+ * counts, rounded down. POSITION_SCALE is a multiple of every mode, so
+ * unlike counts * MICROSTEPS / POSITION_SCALE this cannot overflow.
+ */
+static uint32_t count_steps(uint32_t counts){
+    return counts / (POSITION_SCALE / MICROSTEPS);
+}
+
+/*
+ * Start a ramp over distance counts, the softlimits are already checked.
+ */
+static motion_result_t move_cnt(int64_t distance){
+    uint32_t steps;
+    motor_direction_t direction;
+    
+	if(distance >= 0){
+        if(SW_STATE == FAULT || SW_STATE == LIMIT_POS) return MOTION_LIMIT_SWITCH;
+        direction = CW;
+    }
+    else{
+        if(SW_STATE == FAULT || SW_STATE == LIMIT_NEG) return MOTION_LIMIT_SWITCH;
+        distance = -distance;
+        direction = CCW;
+    }
+    steps = count_steps((uint32_t)distance);
+    
+    // nothing to do below one microstep, like start_plan()
+    if(steps > 0) start_move(steps, direction);
+    return MOTION_OK;
+}
+
+motion_result_t move_relative_cnt(int32_t distance){
+    int64_t target = (int64_t)get_position_cnt() + distance;
+    
+    if(STATE == MOVING) return MOTION_BUSY;
+    // moves back from beyond a softlimit are allowed
+    if(distance < 0 && target < softlimit_neg) return MOTION_BELOW_SOFTLIMIT;
+    if(distance > 0 && target > softlimit_pos) return MOTION_ABOVE_SOFTLIMIT;
+    
+    return move_cnt(distance);
+}
+
+motion_result_t move_absolute_cnt(int32_t target){
+    if(STATE == MOVING) return MOTION_BUSY;
+    if(target < softlimit_neg) return MOTION_BELOW_SOFTLIMIT;
+    if(target > softlimit_pos) return MOTION_ABOVE_SOFTLIMIT;
+    
+    return move_cnt((int64_t)target - get_position_cnt());
+}
+
+motion_result_t move_clamped_cnt(int32_t distance){
+    int32_t position = get_position_cnt();
+    int64_t target = (int64_t)position + distance;
+    
+    if(STATE == MOVING) return MOTION_BUSY;
+    if(target > softlimit_pos) target = softlimit_pos;
+    if(target < softlimit_neg) target = softlimit_neg;
+    
+    // no room left towards the softlimit
+    if((distance >= 0) ? (target <= position) : (target >= position)) return MOTION_OK;
+    
+    return move_cnt(target - position);
+}
+
+motion_result_t plan_move_cnt(int32_t target, move_plan_t* plan){
+    int64_t distance;
+    
+    if(STATE == MOVING) return MOTION_BUSY;
+    if(target < softlimit_neg) return MOTION_BELOW_SOFTLIMIT;
+    if(target > softlimit_pos) return MOTION_ABOVE_SOFTLIMIT;
+    
+    plan->start = get_position_cnt();
+    distance = (int64_t)target - plan->start;
+    plan->direction = (distance >= 0) ? CW : CCW;
+    plan->steps = count_steps((uint32_t)((distance >= 0) ? distance : -distance));
+    split_ramp(plan->steps, &plan->accelerate, &plan->decelerate);
+    
+    // DIR is set now, start_plan() only has to step
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        if(STATE != MOVING && RUN != TRAJECTORY){
+            PIN_WRITE(PIN_DIR, plan->direction == CW);
+            DIRECTION = plan->direction;
+        }
+    }
+    return MOTION_OK;
+}
+
+motion_result_t start_plan(const move_plan_t* plan){
+    if(STATE == MOVING) return MOTION_BUSY;
+    if(MICROSTEPS_CNT != plan->start) return MOTION_INVALID;
+    if(SW_STATE == FAULT) return MOTION_LIMIT_SWITCH;
+    if(SW_STATE == ((plan->direction == CW) ? LIMIT_POS : LIMIT_NEG)) return MOTION_LIMIT_SWITCH;
+    if(plan->steps == 0) return MOTION_OK;
+    
+    // another move or a trajectory changed DIR since planning
+    if(DIRECTION != plan->direction){
+        PIN_WRITE(PIN_DIR, plan->direction == CW);
+        DIRECTION = plan->direction;
+        _delay_us(DRIVER_DIR_SETUP_NS / 1000.0);
+    }
+    limit_cnt = (plan->direction == CW) ? softlimit_pos : softlimit_neg;
+    RUN = NORMAL;
+    
+    trace_clear();
+    trace_countdown = 1;
+    steps_to_accelerate = plan->accelerate;
+    steps_to_decelerate = plan->decelerate;
+    steps_to_move = plan->steps - (plan->accelerate + plan->decelerate);
+    total_steps = plan->steps;
+    step = 0;
+    speed = 0.0;
+    
+    // step at once instead of after the preloaded first interval
+    STATE = MOVING;
+    TCNT1 = 0;
+    run();
+    ramp_step();
+    return MOTION_OK;
+}
+
+#define FOLLOW_TICK_COUNTS (F_CPU / 64 / TELEMETRY_TICK_HZ)	// Timer1 counts per Timer2 tick
+#define FOLLOW_INTERVAL_MIN 10					// shortest step interval, 40 µs
+
+/* the follower steps at up to F_CPU/64/FOLLOW_INTERVAL_MIN */
+#if F_CPU / 64 / FOLLOW_INTERVAL_MIN > DRIVER_STEP_RATE_MAX
+#error "step rate of the trajectory follower out of the driver specs"
+#endif
+
+motion_result_t follow_start(){
+    if(STATE == MOVING) return MOTION_BUSY;
+    if(SW_STATE == FAULT) return MOTION_LIMIT_SWITCH;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        follow_cnt = MICROSTEPS_CNT;
+        follow_rate = 0.0;
+        follow_stopping = 0;
+        RUN = TRAJECTORY;
+        STATE = MOVING;
+        OCR1A = FOLLOW_TICK_COUNTS - 1;
+        TCNT1 = 0;
+        TCCR1B |= (_BV(CS11) | _BV(CS10));
+    }
+    return MOTION_OK;
+}
+
+/*
+ * Set the target of the next tick and spread the steps to it over the
+ * tick. Call with interrupts disabled, the tick computes the target
+ * with interrupts enabled.
+ */
+static void follow_set(int32_t target){
+    uint8_t increment = POSITION_SCALE/MICROSTEPS;
+    int32_t diff;
+    uint16_t interval;
+    
+    if(target > softlimit_pos) target = softlimit_pos;
+    if(target < softlimit_neg) target = softlimit_neg;
+    
+    diff = target - MICROSTEPS_CNT;
+    if((diff > 0 && SW_STATE == LIMIT_POS) || (diff < 0 && SW_STATE == LIMIT_NEG)){
+        target = MICROSTEPS_CNT;
+        diff = 0;
+    }
+    follow_cnt = target;
+    
+    // DIR changes here, so the driver's setup time passes before the next step
+    if(diff > 0 && DIRECTION != CW){
+        PIN_HIGH(PIN_DIR);
+        DIRECTION = CW;
+    }
+    else if(diff < 0){
+        if(DIRECTION != CCW){
+            PIN_LOW(PIN_DIR);
+            DIRECTION = CCW;
+        }
+        diff = -diff;
+    }
+    
+    if(diff < increment) return;
+    
+    if(diff >= (int32_t)increment * (FOLLOW_TICK_COUNTS / FOLLOW_INTERVAL_MIN)){
+        interval = FOLLOW_INTERVAL_MIN;
+    }
+    else{
+        interval = FOLLOW_TICK_COUNTS / ((uint16_t)diff / increment);
+    }
+    OCR1A = interval - 1;
+    TCNT1 = 0;
+}
+
+void follow_target(int32_t target){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        if(!follow_stopping){
+            follow_rate = (float)(target - follow_cnt);
+            follow_set(target);
+        }
+    }
+}
+
+uint8_t follow_braking(){
+    return follow_stopping;
+}
+
+/*
+ * dec is in full steps per s^2, one tick lowers the rate by
+ * dec * POSITION_SCALE / TICK_HZ^2 counts per tick.
+ */
+void follow_brake(){
+    int32_t target;
+    float dv = (float)dec * POSITION_SCALE / ((float)TELEMETRY_TICK_HZ * TELEMETRY_TICK_HZ);
+    
+    if(follow_rate > dv) follow_rate -= dv;
+    else if(follow_rate < -dv) follow_rate += dv;
+    else follow_rate = 0.0;
+    
+    follow_travel += follow_rate;
+    target = follow_origin + (int32_t)((follow_travel < 0) ? follow_travel - 0.5 : follow_travel + 0.5);
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        follow_set(target);
+    }
+    
+    if(follow_rate == 0.0 && follow_reached()){
+        follow_stop();
+    }
+}
+
+uint8_t follow_reached(){
+    uint8_t increment = POSITION_SCALE/MICROSTEPS;
+    int32_t diff = follow_cnt - get_position_cnt();
+    
+    return diff < increment && diff > -(int16_t)increment;
+}
+
+void follow_stop(){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        halt();
+        RUN = NORMAL;
+        follow_stopping = 0;
+        if(STATE == MOVING){
+            STATE = STOPPED;
+            MOTION_FLAG = 1;
+        }
+    }
+}
+
 void set_max_speed(uint16_t max_speed){
 	speed_limit = max_speed;
 }
@@ -301,7 +715,36 @@ void set_deceleration(uint16_t deceleration){
 }
 
 void set_position(float cnt){
-	MICROSTEPS_CNT = (int32_t)(16.0*cnt);
+	set_position_cnt((int32_t)(POSITION_SCALE*cnt));
+}
+
+void set_position_cnt(int32_t cnt){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		MICROSTEPS_CNT = cnt;
+		enforce_softlimits();
+	}
+}
+
+void set_softlimit_pos(int32_t cnt){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		softlimit_pos = cnt;
+		enforce_softlimits();
+	}
+}
+
+void set_softlimit_neg(int32_t cnt){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		softlimit_neg = cnt;
+		enforce_softlimits();
+	}
+}
+
+int32_t get_softlimit_pos(){
+	return softlimit_pos;
+}
+
+int32_t get_softlimit_neg(){
+	return softlimit_neg;
 }
 
 uint16_t get_speed_limit(){
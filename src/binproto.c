@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Binary command protocol for high rate motion control
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#include <util/crc16.h>
+
+#include "A4988.h"
+#include "binproto.h"
+#include "uart.h"
+#include "pvt.h"
+#include "scan.h"
+#include "macro.h"
+#include "sequence.h"
+
+
+static uint8_t crc8(const uint8_t* data, uint8_t len){
+	uint8_t crc = 0;
+	
+	while(len--){
+		crc = _crc8_ccitt_update(crc, *data++);
+	}
+	return crc;
+}
+
+static int32_t read_int32(const uint8_t* data){
+	return (int32_t)((uint32_t)data[0] | ((uint32_t)data[1] << 8)
+				| ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+}
+
+static void write_int32(uint8_t* data, int32_t value){
+	data[0] = (uint8_t)value;
+	data[1] = (uint8_t)(value >> 8);
+	data[2] = (uint8_t)(value >> 16);
+	data[3] = (uint8_t)(value >> 24);
+}
+
+/*
+ * Complete a reply frame in buf (SYNC, opcode, payload) with its CRC
+ * and queue it.
+ */
+static void send_reply(uint8_t* buf, uint8_t payload_len){
+	buf[2 + payload_len] = crc8(buf + 1, 1 + payload_len);
+	uart_write((const char*)buf, 3 + payload_len);
+}
+
+void binproto_execute(const uint8_t* frame){
+	uint8_t opcode = frame[0];
+	uint8_t len = binproto_payload_len(opcode);
+	uint8_t reply[3 + BINPROTO_FRAME_MAX];
+	
+	reply[0] = BINPROTO_SYNC;
+	reply[1] = opcode | BINPROTO_REPLY;
+	
+	if(crc8(frame, 1 + len) != frame[1 + len]){
+		reply[1] = BINPROTO_NAK;
+		reply[2] = BINPROTO_NAK_CRC;
+		send_reply(reply, 1);
+		return;
+	}
+	
+	switch(opcode){
+		case BINPROTO_MOVE_ABS:
+			reply[2] = move_absolute_cnt(read_int32(frame + 1));
+			send_reply(reply, 1);
+			break;
+			
+		case BINPROTO_MOVE_REL:
+			reply[2] = move_relative_cnt(read_int32(frame + 1));
+			send_reply(reply, 1);
+			break;
+			
+		case BINPROTO_STOP:
+			macro_stop();
+			sequence_stop();
+			scan_stop();
+			soft_stop();
+			reply[2] = MOTION_OK;
+			send_reply(reply, 1);
+			break;
+			
+		case BINPROTO_SNAPSHOT:
+			write_int32(reply + 2, get_position_cnt());
+			reply[6] = get_motor_state();
+			reply[7] = get_switch_state();
+			send_reply(reply, 6);
+			break;
+			
+		case BINPROTO_PVT:
+			reply[2] = pvt_add(read_int32(frame + 1), read_int32(frame + 5),
+					(uint16_t)(frame[9] | (frame[10] << 8)));
+			reply[3] = pvt_free();
+			send_reply(reply, 2);
+			break;
+			
+		case BINPROTO_PVT_START:
+			reply[2] = pvt_start();
+			send_reply(reply, 1);
+			break;
+	}
+}
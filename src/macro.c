@@ -0,0 +1,311 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Stored command sequences (macros)
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "macro.h"
+
+/*
+ * Step arguments are stored back to back in text as
+ * <count><length><chars><length><chars>...
+ */
+struct macro_step{
+	command_callback_t callback;
+	uint8_t args;		// offset of the arguments in text
+};
+
+struct macro{
+	char name[MACRO_NAME_MAX];		// upper case, empty slot if name[0] == 0
+	uint8_t steps;
+	uint8_t text_length;
+	struct macro_step step[MACRO_STEPS];
+	char text[MACRO_TEXT];
+};
+
+static struct macro macros[MACRO_COUNT];
+
+static struct macro* running;	// NULL if idle
+static uint8_t next_step;
+static uint8_t in_step;			// a step of the running macro executes
+static uint16_t loops;
+static uint16_t loops_done;
+
+extern volatile uint8_t MOTION_FLAG;
+
+
+static uint8_t valid_name(const char* name, uint8_t length){
+	uint8_t i;
+
+	if(length == 0 || length > MACRO_NAME_MAX) return 0;
+
+	for(i = 0; i < length; i++){
+		if(!isalnum(name[i]) && name[i] != '_') return 0;
+	}
+	return 1;
+}
+
+static struct macro* find(const char* name, uint8_t length){
+	uint8_t i;
+	uint8_t j;
+
+	for(i = 0; i < MACRO_COUNT; i++){
+		for(j = 0; j < length; j++){
+			if(macros[i].name[j] != toupper(name[j])) break;
+		}
+		if(j == length && (length == MACRO_NAME_MAX || macros[i].name[length] == 0)){
+			return &macros[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Resolve one command and store it as the next step of m.
+ */
+static macro_result_t add_step(struct scpi_parser_context* ctx, struct macro* m, const char* unit, uint8_t length){
+	struct scpi_token* tokens;
+	struct scpi_token* token;
+	const struct scpi_command* command;
+	uint8_t count_at;
+	macro_result_t result = MACRO_OK;
+
+	tokens = scpi_parse_string(unit, length);
+	if(tokens == NULL) return MACRO_FULL;		// out of heap
+
+	command = scpi_find_command(ctx, tokens);
+
+	if(command == NULL || scpi_command_callback(command) == NULL){
+		result = MACRO_UNDEFINED;
+	}
+	else if(m->steps == MACRO_STEPS || m->text_length == MACRO_TEXT){
+		result = MACRO_FULL;
+	}
+	else{
+		count_at = m->text_length++;
+		m->text[count_at] = 0;
+
+		for(token = tokens; token != NULL; token = token->next){
+			if(token->type == 0) continue;
+
+			if(token->length >= MACRO_TEXT - m->text_length){
+				result = MACRO_FULL;
+				break;
+			}
+			m->text[m->text_length++] = token->length;
+			memcpy(m->text + m->text_length, token->value, token->length);
+			m->text_length += token->length;
+			m->text[count_at]++;
+		}
+
+		m->step[m->steps].callback = scpi_command_callback(command);
+		m->step[m->steps].args = count_at;
+		m->steps++;
+	}
+
+	scpi_free_tokens(tokens);
+	return result;
+}
+
+/*
+ * The steps are resolved straight into a macro slot, without a copy on
+ * the stack. A new definition goes to a free slot and replaces the old
+ * one only once it is complete, appended steps are cut off again if
+ * one of them is refused.
+ */
+macro_result_t macro_define(struct scpi_parser_context* ctx, const char* name, uint8_t name_length, const char* body, uint8_t length, uint8_t append){
+	struct macro* m;
+	struct macro* slot;
+	const struct scpi_command* path;
+	macro_result_t result = MACRO_OK;
+	uint8_t steps;
+	uint8_t text_length;
+	uint8_t start = 0;
+	uint8_t end;
+	uint8_t i;
+	uint8_t quoted = 0;
+
+	if(running != NULL) return MACRO_BUSY;
+	if(!valid_name(name, name_length)) return MACRO_INVALID;
+
+	slot = find(name, name_length);
+	if(append){
+		if(slot == NULL) return MACRO_UNKNOWN;
+		m = slot;
+	}
+	else{
+		m = find("", 0);		// first empty slot
+		if(m == NULL) m = slot;	// all taken, redefine in place
+		if(m == NULL) return MACRO_FULL;
+
+		m->steps = 0;
+		m->text_length = 0;
+	}
+	steps = m->steps;
+	text_length = m->text_length;
+
+	// headers are resolved like a message of their own, from the root
+	path = ctx->current_path;
+	ctx->current_path = NULL;
+
+	for(i = 0; i <= length && result == MACRO_OK; i++){
+		if(i < length && body[i] == '"'){
+			quoted = !quoted;
+		}
+		if(i < length && (quoted || body[i] != ';')) continue;
+
+		end = i;
+		while(start < end && isspace(body[start])) start++;
+		while(end > start && isspace(body[end-1])) end--;
+
+		if(end > start){
+			result = add_step(ctx, m, body + start, end - start);
+		}
+		start = i+1;
+	}
+
+	ctx->current_path = path;
+
+	if(result == MACRO_OK && m->steps == 0) result = MACRO_INVALID;
+
+	if(result != MACRO_OK){
+		m->steps = steps;
+		m->text_length = text_length;
+		if(!append && m == slot){
+			slot->name[0] = 0;		// the old definition is gone
+		}
+		return result;
+	}
+
+	if(!append && m != slot){
+		memset(m->name, 0, MACRO_NAME_MAX);
+		for(i = 0; i < name_length; i++){
+			m->name[i] = toupper(name[i]);
+		}
+		if(slot != NULL){
+			slot->name[0] = 0;
+		}
+	}
+	return MACRO_OK;
+}
+
+macro_result_t macro_delete(const char* name, uint8_t name_length){
+	struct macro* slot;
+
+	if(running != NULL) return MACRO_BUSY;
+
+	slot = valid_name(name, name_length) ? find(name, name_length) : NULL;
+	if(slot == NULL) return MACRO_UNKNOWN;
+
+	slot->name[0] = 0;
+	return MACRO_OK;
+}
+
+macro_result_t macro_run(const char* name, uint8_t name_length, uint16_t count){
+	struct macro* slot;
+
+	if(running != NULL) return MACRO_BUSY;
+	if(count == 0) return MACRO_INVALID;
+
+	slot = valid_name(name, name_length) ? find(name, name_length) : NULL;
+	if(slot == NULL) return MACRO_UNKNOWN;
+
+	running = slot;
+	next_step = 0;
+	loops = count;
+	loops_done = 0;
+	return MACRO_OK;
+}
+
+void macro_stop(){
+	if(running != NULL){
+		running = NULL;
+		MOTION_FLAG = 1;	// completes *OPC and sends the event line
+	}
+}
+
+uint8_t macro_running(){
+	return running != NULL && !in_step;
+}
+
+uint16_t macro_loops_done(){
+	return loops_done;
+}
+
+uint16_t macro_loops(){
+	return loops;
+}
+
+const char* macro_name(uint8_t index){
+	if(index >= MACRO_COUNT || macros[index].name[0] == 0) return NULL;
+
+	return macros[index].name;
+}
+
+/*
+ * Build the argument tokens of a step. They are freed by the callback
+ * like the tokens of scpi_parse_string().
+ */
+static struct scpi_token* step_tokens(const char* args, uint8_t* complete){
+	struct scpi_token* head = NULL;
+	struct scpi_token** tail = &head;
+	uint8_t count = *args++;
+
+	*complete = 1;
+	while(count-- > 0){
+		*tail = (struct scpi_token*)malloc(sizeof(struct scpi_token));
+		if(*tail == NULL){
+			*complete = 0;
+			scpi_free_tokens(head);
+			return NULL;
+		}
+		(*tail)->type = 1;
+		(*tail)->length = (uint8_t)*args++;
+		(*tail)->value = args;
+		(*tail)->next = NULL;
+		args += (*tail)->length;
+		tail = &(*tail)->next;
+	}
+	return head;
+}
+
+void macro_service(struct scpi_parser_context* ctx){
+	struct macro_step* step;
+	struct scpi_token* tokens;
+	uint8_t complete;
+
+	if(running == NULL) return;
+
+	step = &running->step[next_step];
+
+	// a step without all of its arguments must not run
+	tokens = step_tokens(running->text + step->args, &complete);
+	if(!complete){
+		macro_stop();
+		return;
+	}
+
+	in_step = 1;
+	ctx->suspend_request = 0;
+	step->callback(ctx, tokens);
+	in_step = 0;
+
+	// a suspended step (*WAI, *OPC?) runs again in the next iteration
+	if(ctx->suspend_request){
+		ctx->suspend_request = 0;
+		return;
+	}
+
+	if(running == NULL) return;		// the step stopped the macro
+
+	if(++next_step == running->steps){
+		next_step = 0;
+		if(++loops_done == loops){
+			macro_stop();
+		}
+	}
+}
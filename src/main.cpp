@@ -10,6 +10,16 @@
 #include <scpiparser.h>
 #include "A4988.h"
 #include "scpi_functions.h"
+#include "uart.h"
+#include "binproto.h"
+#include "pvt.h"
+#include "scan.h"
+#include "macro.h"
+#include "sequence.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "profile.h"
+#include "nvm.h"
 
 
 struct scpi_parser_context ctx;
@@ -17,117 +27,243 @@ char response_buffer[BUF_LEN];
 uint8_t response_len;
 
 volatile uint8_t UPDATE_FLAG;
+volatile uint8_t MOTION_FLAG;
 
-void setup() {
-  
-  // initialize A4988 pins as an outputs
-  DDRB |= (_BV(DIR) | _BV(STEP) | _BV(SLEEP) | _BV(RESET) | _BV(MS3) | _BV(PB5));
-  DDRD |= (_BV(ENABLE) | _BV(MS1) | _BV(MS2));
-  
-  // initialize switches as tri state inputs
-  DDRD &= ~(_BV(SW_NEG) | _BV(SW_POS));
-  PORTD &= ~(_BV(SW_NEG) | _BV(SW_POS));     // Tri-State
-  
-  // driver outputs low while initializing
-  PORTB &= ~( _BV(SLEEP) | _BV(RESET) );
-  PORTD |= _BV(ENABLE);
-  
-  PCICR |= _BV(PCIE2);
-  PCMSK2 = 0x00;
-  PCMSK2 |= (_BV(PCINT18) | _BV(PCINT20));
-  
-  
-  Serial.begin(9600);
-  initialize_timer1();
-  
-  sei();	// enable interrupts
-  
-  
+static const char err_too_much_data[] PROGMEM = "Too much data";
 
-  struct scpi_command* motor;
-  struct scpi_command* limit;
-  struct scpi_command* move;
-  struct scpi_command* home;
+/*
+ * Command tree, see scpi_init(). MOTor is optional, :POS? is the same
+ * as :MOT:POS?.
+ */
+static const struct scpi_command commands[] PROGMEM = {
+  /* level, flags, keyword, callback */
+  {0, 0, "SYSTem", NULL},
+  {1, 0,   "ERRor", NULL},
+  {2, 0,     "NEXT?", scpi_system_error},
+  {2, 0,     "COUNt?", scpi_system_error_count},
+  {1, 0,   "ERRor?", scpi_system_error},
+  {1, 0,   "COMMunicate", NULL},
+  {2, 0,     "TXSTatistics?", scpi_get_tx_statistics},
+  {2, 0,     "BAUD", scpi_set_baud},
+  {2, 0,     "BAUD?", scpi_get_baud},
+  {1, 0,   "EVENt", scpi_set_events},
+  {1, 0,   "EVENt?", scpi_get_events},
+  {1, 0,   "MACRo", NULL},
+  {2, 0,     "DEFine", scpi_define_macro},
+  {2, 0,     "APPend", scpi_append_macro},
+  {2, 0,     "RUN", scpi_run_macro},
+  {2, 0,     "STOP", scpi_stop_macro},
+  {2, 0,     "DELete", scpi_delete_macro},
+  {2, 0,     "CATalog?", scpi_get_macro_catalog},
+  {2, 0,     "PROGress?", scpi_get_macro_progress},
   
-  scpi_init(&ctx);
+  {0, 0, "*CLS", scpi_clear_status},
+  {0, 0, "*IDN?", identify},
+  {0, 0, "*OPC", scpi_operation_complete},
+  {0, 0, "*OPC?", scpi_operation_complete_query},
+  {0, 0, "*WAI", scpi_wait},
+  {0, 0, "*ESR?", scpi_get_event_status},
+  {0, 0, "*SAV", scpi_save_profile},
+  {0, 0, "*RCL", scpi_recall_profile},
   
-  scpi_register_command(ctx.command_tree, SCPI_CL_SAMELEVEL, "*IDN?", 5, "*IDN?", 5, identify);
+  {0, 0, "DIAGnostic", NULL},
+  {1, 0,   "TRACe", NULL},
+  {2, 0,     "DECimation", scpi_set_trace_decimation},
+  {2, 0,     "DECimation?", scpi_get_trace_decimation},
+  {2, 0,     "COUNt?", scpi_get_trace_count},
+  {2, 0,     "DATA?", scpi_get_trace_data},
+#ifdef PROFILE
+  {1, 0,   "PROFile?", scpi_get_profile},
+  {1, 0,   "PROFile", NULL},
+  {2, 0,     "RESet", scpi_reset_profile},
+#endif
   
-  motor = scpi_register_command(ctx.command_tree, SCPI_CL_CHILD, "MOTOR", 5, "MOT", 3, NULL);
-  limit = scpi_register_command(motor, SCPI_CL_CHILD, "LIMIT", 5, "LIM", 3, NULL);
-  move = scpi_register_command(motor, SCPI_CL_CHILD, "MOVE", 4, "MOV", 3, NULL);
-  home = scpi_register_command(motor, SCPI_CL_CHILD, "HOME", 4, "HOM", 3, NULL);
+  {0, SCPI_CF_OPTIONAL, "MOTor", NULL},
+  {1, 0,   "LIMit", NULL},
+  {2, 0,     "POSitive", scpi_set_softlimit_pos},
+  {2, 0,     "POSitive?", scpi_get_softlimit_pos},
+  {2, 0,     "NEGative", scpi_set_softlimit_neg},
+  {2, 0,     "NEGative?", scpi_get_softlimit_neg},
+  {1, 0,   "MOVe", NULL},
+  {2, 0,     "ABSolute", scpi_move_absolute},
+  {2, 0,     "RELative", scpi_move_relative},
+  {1, 0,   "HOMe", NULL},
+  {2, 0,     "POSitive", scpi_home_pos},
+  {2, 0,     "NEGative", scpi_home_neg},
+  {1, 0,   "STOP", scpi_soft_stop},
+  {1, 0,   "STP", scpi_soft_stop},
+  {1, 0,   "STate?", scpi_get_state},
+  {1, 0,   "STReam", scpi_set_stream},
+  {1, 0,   "STReam?", scpi_get_stream},
+  {1, 0,   "POSition", scpi_set_position},
+  {2, 0,     "VALid?", scpi_get_position_valid},
+  {1, 0,   "POSition?", scpi_get_position},
+  {1, 0,   "ACCeleration", scpi_set_acceleration},
+  {1, 0,   "ACCeleration?", scpi_get_acceleration},
+  {1, 0,   "DECeleration", scpi_set_deceleration},
+  {1, 0,   "DECeleration?", scpi_get_deceleration},
+  {1, 0,   "SPeed", scpi_set_max_speed},
+  {1, 0,   "SPeed?", scpi_get_speed_limit},
+  {1, 0,   "SCALe", scpi_set_scale},
+  {1, 0,   "SCALe?", scpi_get_scale},
+  {1, 0,   "UNIT", scpi_set_unit},
+  {1, 0,   "UNIT?", scpi_get_unit},
+  {1, 0,   "DRIVer?", scpi_get_driver},
+  {1, 0,   "PVT", scpi_add_pvt},
+  {2, 0,     "STARt", scpi_start_pvt},
+  {2, 0,     "CLEar", scpi_clear_pvt},
+  {2, 0,     "FREE?", scpi_get_pvt_free},
+  {2, 0,     "STate?", scpi_get_pvt_state},
+  {1, 0,   "SCAN", scpi_start_scan},
+  {2, 0,     "MODE", scpi_set_scan_mode},
+  {2, 0,     "MODE?", scpi_get_scan_mode},
+  {2, 0,     "TRIGger", scpi_set_scan_trigger},
+  {2, 0,     "TRIGger?", scpi_get_scan_trigger},
+  {2, 0,     "PROGress?", scpi_get_scan_progress},
+  {1, 0,   "LIST", scpi_add_list},
+  {2, 0,     "CLEar", scpi_clear_list},
+  {2, 0,     "STARt", scpi_start_list},
+  {2, 0,     "STOP", scpi_stop_list},
+  {2, 0,     "EDGE", scpi_set_list_edge},
+  {2, 0,     "EDGE?", scpi_get_list_edge},
+  {2, 0,     "COUNt?", scpi_get_list_count},
+  {2, 0,     "INDex?", scpi_get_list_index},
+  {2, 0,     "OVERrun?", scpi_get_list_overruns},
+  {2, 0,     "STate?", scpi_get_list_state},
+};
+
+void setup() {
   
+  // a watchdog reset after a power dip leaves the watchdog running, see nvm.c
+  MCUSR = 0;
+  wdt_disable();
   
-  scpi_register_command(move, SCPI_CL_CHILD, "ABSOLUTE", 8, "ABS", 3, scpi_move_absolute);
-  scpi_register_command(move, SCPI_CL_CHILD, "RELATIVE", 8, "REL", 3, scpi_move_relative);
+  // initialize driver pins as an outputs
+  PIN_OUTPUT(PIN_DIR);
+  PIN_OUTPUT(PIN_STEP);
+  PIN_OUTPUT(PIN_SLEEP);
+  PIN_OUTPUT(PIN_RESET);
+  PIN_OUTPUT(PIN_ENABLE);
+  PIN_OUTPUT(PIN_MS1);
+  PIN_OUTPUT(PIN_MS2);
+  PIN_OUTPUT(PIN_MS3);
+  PIN_OUTPUT(PIN_LED);
   
-  scpi_register_command(motor, SCPI_CL_CHILD, "STOP", 4, "STP", 3, scpi_soft_stop);
-  scpi_register_command(motor, SCPI_CL_CHILD, "STATE?", 6, "ST?", 3, scpi_get_state);
+  // initialize switches as tri state inputs
+  PIN_INPUT(PIN_SW_NEG);
+  PIN_INPUT(PIN_SW_POS);
+  PIN_TRISTATE(PIN_SW_NEG);
+  PIN_TRISTATE(PIN_SW_POS);
   
+  // position list trigger, pulled up while not connected
+  PIN_INPUT(PIN_LIST_TRIGGER);
+  PIN_PULLUP(PIN_LIST_TRIGGER);
   
-  scpi_register_command(motor, SCPI_CL_CHILD, "POSITION", 8, "POS", 3, scpi_set_position);
-  scpi_register_command(motor, SCPI_CL_CHILD, "POSITION?", 9, "POS?", 4, scpi_get_position);
+  // driver outputs low while initializing
+  PIN_LOW(PIN_SLEEP);
+  PIN_LOW(PIN_RESET);
+  PIN_HIGH(PIN_ENABLE);
   
-  scpi_register_command(motor, SCPI_CL_CHILD, "ACCELERATION", 12, "ACC", 3, scpi_set_acceleration);
-  scpi_register_command(motor, SCPI_CL_CHILD, "ACCELERATION?", 13, "ACC?", 4, scpi_get_acceleration);
+  PIN_PCINT_ENABLE(PIN_SW_NEG);
+  PIN_PCINT_ENABLE(PIN_SW_POS);
   
-  scpi_register_command(motor, SCPI_CL_CHILD, "DECELERATION", 12, "DEC", 3, scpi_set_deceleration);
-  scpi_register_command(motor, SCPI_CL_CHILD, "DECELERATION?", 13, "DEC?", 4, scpi_get_deceleration);
   
-  scpi_register_command(motor, SCPI_CL_CHILD, "SPEED", 5, "SP", 2, scpi_set_max_speed);
-  scpi_register_command(motor, SCPI_CL_CHILD, "SPEED?", 6, "SP?", 3, scpi_get_speed_limit);
+  uart_init(uart_power_on_baud());
+  initialize_timer1();
+  telemetry_init();
+  nvm_recall_profile(0);	// power-on profile, firmware defaults if empty
+  nvm_init();				// restore the journaled position
   
-  scpi_register_command(limit, SCPI_CL_CHILD, "POSITIVE", 8, "POS", 3, scpi_set_softlimit_pos);
-  scpi_register_command(limit, SCPI_CL_CHILD, "POSITIVE?", 9, "POS?", 4, scpi_get_softlimit_pos);
+  sei();	// enable interrupts
   
-  scpi_register_command(limit, SCPI_CL_CHILD, "NEGATIVE", 8, "NEG", 3, scpi_set_softlimit_neg);
-  scpi_register_command(limit, SCPI_CL_CHILD, "NEGATIVE?", 9, "NEG?", 4, scpi_get_softlimit_neg);
   
-  scpi_register_command(home, SCPI_CL_CHILD, "POSITIVE", 8, "POS", 3, scpi_home_pos);
-  scpi_register_command(home, SCPI_CL_CHILD, "NEGATIVE", 8, "NEG", 3, scpi_home_neg);
+
+  scpi_init(&ctx, commands, sizeof(commands)/sizeof(commands[0]));
 }
 
 
 void loop(){
-	set_microstepping(QUARTER);
+	set_microstepping((microstep_t)DRIVER_MICROSTEPS_DEFAULT);
     
     // driver outputs high after startup
-    PORTB |= (_BV(SLEEP) | _BV(RESET));
-    PORTD &= ~_BV(ENABLE);
+#if DRIVER_SLEEP_RESET
+    PIN_HIGH(PIN_SLEEP);
+    PIN_HIGH(PIN_RESET);
+#endif
+    PIN_LOW(PIN_ENABLE);
     
     update_state();
     
-    char line_buffer[128];
-	unsigned char read_length;
+    char line_buffer[UART_LINE_MAX];
+	int16_t read_length;
+	uint8_t dropped;
+	uint8_t frame[BINPROTO_FRAME_MAX];
 
 	while(1){   
-        if (Serial.available()){
-            read_length = Serial.readBytesUntil('\n', line_buffer, 128);
-            
-            if(read_length > 0)
+        PROFILE_BEGIN_LONG(loop_start);
+        
+        if(MOTION_FLAG == 1){
+            MOTION_FLAG = 0;
+            scpi_motion_event();
+        }
+        
+        // a message waiting for motion (*WAI, *OPC?) blocks further lines
+        if(scpi_is_suspended(&ctx))
+        {
+            if(!scpi_operation_pending())
             {
-                scpi_execute_command(&ctx, line_buffer, read_length);
+                scpi_resume_message(&ctx);
             }
-		
-            if (response_len > 0) // hier wäre response_len klüger
+        }
+        
+        else
+        {
+            read_length = uart_read_line(line_buffer, UART_LINE_MAX);
+            
+            if(read_length > 0)
             {
-                Serial.write(response_buffer, response_len);
-                response_len = 0;
+                // any command ends streaming, STReam itself restarts it
+                telemetry_stop();
+                PROFILE_BEGIN_LONG(command_start);
+                scpi_execute_message(&ctx, line_buffer, read_length);
+                PROFILE_END_LONG(PROFILE_COMMAND, command_start);
             }
         }
         
+        macro_service(&ctx);
+        
+        if (response_len > 0 && !scpi_is_suspended(&ctx))
+        {
+            uart_write(response_buffer, response_len);
+            response_len = 0;
+        }
+        
+        if(uart_read_frame(frame))
+        {
+            telemetry_stop();
+            PROFILE_BEGIN_LONG(frame_start);
+            binproto_execute(frame);
+            PROFILE_END_LONG(PROFILE_FRAME, frame_start);
+        }
+        
+        for(dropped = uart_dropped_lines(); dropped > 0; dropped--)
+        {
+            queue_error(-223, err_too_much_data);
+        }
+        
         if(UPDATE_FLAG == 1){
             _delay_ms(50);
             update_state();
             UPDATE_FLAG = 0;
         }
         
-        if (response_len > 0) // hier wäre response_len klüger
-            {
-                Serial.write(response_buffer, response_len);
-                response_len = 0;
-            }
-		
+        pvt_service();
+        scan_service();
+        sequence_service();
+        telemetry_service();
+        nvm_journal_service();
+        uart_service();
+        
+        PROFILE_END_LONG(PROFILE_LOOP, loop_start);
 	}
 }
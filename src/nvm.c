@@ -0,0 +1,259 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Configuration profiles and position journal in EEPROM
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#include <stddef.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/wdt.h>
+#include <util/crc16.h>
+#include <Arduino.h>
+
+#include "nvm.h"
+#include "A4988.h"
+#include "units.h"
+#include "pvt.h"
+#include "scan.h"
+#include "macro.h"
+#include "sequence.h"
+
+struct profile{
+	uint8_t version;
+	uint16_t speed_limit;
+	uint16_t acceleration;
+	uint16_t deceleration;
+	int32_t softlimit_pos;
+	int32_t softlimit_neg;
+	int32_t scale_counts;
+	int32_t scale_base;
+	uint8_t scale_axis;
+	uint8_t report_unit;
+	uint8_t crc;			// CRC-8 of all bytes above
+};
+
+struct journal_entry{
+	uint32_t seq;			// the newest entry has the highest sequence number
+	int32_t position;
+	uint8_t flags;
+	uint8_t crc;			// CRC-8 of all bytes above, written last
+};
+
+EEMEM struct profile ee_profiles[NVM_PROFILES];
+EEMEM struct journal_entry ee_journal[NVM_JOURNAL_SLOTS];
+
+static struct journal_entry journal_buf;	// entry being written
+static uint8_t journal_written;			// bytes of journal_buf written, sizeof if idle
+static uint8_t journal_next;			// slot for the next entry
+static uint32_t journal_seq;
+static int32_t journal_position;		// position of the last entry
+static uint8_t journal_moving;			// the last entry marks a move start
+static unsigned long busy_at;			// millis() when motion was last seen
+static uint8_t position_trusted;
+
+
+/*
+ * Profiles and journal hold position counts. The seed makes them fail
+ * the CRC in a build for a driver with another POSITION_SCALE, it is 0
+ * for 16 counts per full step.
+ */
+static uint8_t crc8(const uint8_t* data, uint8_t len){
+	uint8_t crc = (uint8_t)(POSITION_SCALE - 16);
+	
+	while(len--){
+		crc = _crc8_ccitt_update(crc, *data++);
+	}
+	return crc;
+}
+
+void nvm_save_profile(uint8_t slot){
+	struct profile p;
+	
+	p.version = NVM_VERSION;
+	p.speed_limit = get_speed_limit();
+	p.acceleration = get_acceleration();
+	p.deceleration = get_deceleration();
+	p.softlimit_pos = get_softlimit_pos();
+	p.softlimit_neg = get_softlimit_neg();
+	units_get_scale(&p.scale_counts, &p.scale_base, &p.scale_axis);
+	p.report_unit = units_get_report();
+	p.crc = crc8((const uint8_t*)&p, offsetof(struct profile, crc));
+	
+	eeprom_update_block(&p, &ee_profiles[slot], sizeof(p));
+}
+
+/*
+ * An erased slot reads 0xFF and fails the version check.
+ */
+uint8_t nvm_recall_profile(uint8_t slot){
+	struct profile p;
+	
+	eeprom_read_block(&p, &ee_profiles[slot], sizeof(p));
+	
+	if(p.version != NVM_VERSION || p.crc != crc8((const uint8_t*)&p, offsetof(struct profile, crc))){
+		return 0;
+	}
+	
+	set_max_speed(p.speed_limit);
+	set_acceleration(p.acceleration);
+	set_deceleration(p.deceleration);
+	set_softlimit_pos(p.softlimit_pos);
+	set_softlimit_neg(p.softlimit_neg);
+	units_set_scale(p.scale_counts, p.scale_base, p.scale_axis);
+	units_set_report(p.report_unit);
+	return 1;
+}
+
+
+/*
+ * Journal
+ *
+ * Every entry goes to the next slot of the ring, so each EEPROM cell is
+ * written only once per NVM_JOURNAL_SLOTS entries. A motion costs two
+ * entries, one at the start and one once the axis has settled. Scans,
+ * macros, position lists and trajectories count as one motion, however
+ * many moves they make. An entry interrupted by a reset fails its CRC
+ * and the previous one is used.
+ */
+static void journal_start(int32_t position, uint8_t flags){
+	journal_buf.seq = journal_seq++;
+	journal_buf.position = position;
+	journal_buf.flags = flags;
+	journal_buf.crc = crc8((const uint8_t*)&journal_buf, offsetof(struct journal_entry, crc));
+	journal_written = 0;
+	
+	journal_position = position;
+	journal_moving = (flags & NVM_JOURNAL_MOVING) != 0;
+}
+
+/*
+ * Write the next byte of journal_buf, returns 0 once the entry is
+ * complete. Waits for the EEPROM only if wait is set.
+ */
+static uint8_t journal_write_byte(uint8_t wait){
+	uint8_t* dst;
+	
+	if(journal_written >= sizeof(journal_buf)){
+		return 0;
+	}
+	if(!wait && !eeprom_is_ready()){
+		return 1;
+	}
+	
+	dst = (uint8_t*)&ee_journal[journal_next] + journal_written;
+	eeprom_update_byte(dst, ((const uint8_t*)&journal_buf)[journal_written]);
+	
+	if(++journal_written == sizeof(journal_buf)){
+		journal_next = (journal_next + 1) % NVM_JOURNAL_SLOTS;
+		return 0;
+	}
+	return 1;
+}
+
+void nvm_init(){
+	struct journal_entry entry;
+	uint8_t newest = NVM_JOURNAL_SLOTS;
+	uint8_t i;
+	
+	for(i = 0; i < NVM_JOURNAL_SLOTS; i++){
+		eeprom_read_block(&entry, &ee_journal[i], sizeof(entry));
+		
+		if(entry.flags == 0 || entry.crc != crc8((const uint8_t*)&entry, offsetof(struct journal_entry, crc))){
+			continue;
+		}
+		if(newest == NVM_JOURNAL_SLOTS || entry.seq >= journal_seq){
+			newest = i;
+			journal_seq = entry.seq + 1;
+			journal_position = entry.position;
+			position_trusted = (entry.flags & NVM_JOURNAL_STOPPED) != 0;
+		}
+	}
+	
+	journal_written = sizeof(journal_buf);
+	
+	if(newest != NVM_JOURNAL_SLOTS){
+		journal_next = (newest + 1) % NVM_JOURNAL_SLOTS;
+		set_position_cnt(journal_position);
+	}
+	
+#ifdef NVM_POWER_FAIL
+	PIN_INPUT(PIN_POWER_FAIL);
+	PIN_PULLUP(PIN_POWER_FAIL);
+	PIN_PCINT_ENABLE(PIN_POWER_FAIL);
+#endif
+}
+
+/*
+ * The axis may move again without a new host command.
+ */
+static uint8_t journal_busy(){
+	return get_motor_state() == MOVING || pvt_status() == PVT_RUNNING
+		|| scan_running() || macro_running() || sequence_armed();
+}
+
+void nvm_journal_service(){
+	int32_t position;
+	
+	if(journal_busy()){
+		busy_at = millis();
+	}
+	
+	if(journal_write_byte(0)){
+		return;
+	}
+	
+	position = get_position_cnt();
+	
+	if(journal_busy()){
+		if(!journal_moving){
+			journal_start(position, NVM_JOURNAL_MOVING);
+		}
+	}
+	else if(journal_moving){
+		// the next move of a command sequence reuses the open entry
+		if(millis() - busy_at >= NVM_JOURNAL_SETTLE_MS){
+			journal_start(position, NVM_JOURNAL_STOPPED);
+		}
+	}
+	else if(position != journal_position){
+		journal_start(position, NVM_JOURNAL_STOPPED);
+	}
+}
+
+uint8_t nvm_position_trusted(){
+	return position_trusted;
+}
+
+void nvm_position_confirmed(){
+	position_trusted = 1;
+}
+
+#ifdef NVM_POWER_FAIL
+/*
+ * Stop the motor, complete a pending entry and write the final one
+ * with busy waiting. Then wait for the power to go, or for a watchdog
+ * reset if it was only a dip.
+ */
+ISR(PIN_PCINT_vect(PIN_POWER_FAIL)){
+	uint8_t flags = NVM_JOURNAL_POWER_FAIL;
+	
+	if(PIN_READ(PIN_POWER_FAIL)) return;
+	
+	if(get_motor_state() == MOVING){
+		halt();
+		STATE = STOPPED;
+	}
+	else{
+		flags |= NVM_JOURNAL_STOPPED;
+	}
+	
+	while(journal_write_byte(1));
+	journal_start(get_position_cnt(), flags);
+	while(journal_write_byte(1));
+	
+	wdt_enable(WDTO_15MS);
+	while(1);
+}
+#endif
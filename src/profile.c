@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Optional run time profiling, enabled with -DPROFILE
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#include "profile.h"
+
+#ifdef PROFILE
+
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+#include <scpiparser.h>
+
+struct profile_slot{
+    uint32_t count;
+    uint32_t total;		// ticks
+    uint16_t max;		// ticks
+};
+
+static volatile struct profile_slot slots[PROFILE_SLOTS];
+
+static const char name_step[] PROGMEM = "STEP";
+static const char name_command[] PROGMEM = "CMD";
+static const char name_frame[] PROGMEM = "FRAME";
+static const char name_loop[] PROGMEM = "LOOP";
+
+static const char* const slot_names[PROFILE_SLOTS] PROGMEM = {
+    name_step, name_command, name_frame, name_loop
+};
+
+
+void profile_add(uint8_t slot, uint16_t ticks){
+    slots[slot].count++;
+    slots[slot].total += ticks;
+    if(ticks > slots[slot].max){
+        slots[slot].max = ticks;
+    }
+}
+
+void profile_add_us(uint8_t slot, unsigned long us){
+    us /= PROFILE_TICK_CYCLES / (F_CPU / 1000000UL);
+    profile_add(slot, (us > 0xFFFF) ? 0xFFFF : (uint16_t)us);
+}
+
+void profile_reset(){
+    uint8_t i;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        for(i = 0; i < PROFILE_SLOTS; i++){
+            slots[i].count = 0;
+            slots[i].total = 0;
+            slots[i].max = 0;
+        }
+    }
+}
+
+void profile_report(){
+    struct profile_slot slot;
+    uint8_t i;
+
+    for(i = 0; i < PROFILE_SLOTS; i++){
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+            slot.count = slots[i].count;
+            slot.total = slots[i].total;
+            slot.max = slots[i].max;
+        }
+
+        if(i > 0){
+            scpi_putc(';');
+        }
+        scpi_puts_P((const char*)pgm_read_ptr(&slot_names[i]));
+        scpi_putc(',');
+        scpi_print_int(slot.count);
+        scpi_putc(',');
+        scpi_print_int(slot.count ? slot.total / slot.count * PROFILE_TICK_CYCLES : 0);
+        scpi_putc(',');
+        scpi_print_int((int32_t)slot.max * PROFILE_TICK_CYCLES);
+    }
+    scpi_putc('\n');
+}
+
+#endif
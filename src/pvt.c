@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Position-velocity-time trajectories
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "pvt.h"
+#include "A4988.h"
+
+struct point{
+	int32_t position;
+	int32_t velocity;
+	uint16_t time;
+};
+
+/*
+ * p(s) = p0 + s*(c1 + s*(c2 + s*c3)) for s = k/n, 0 <= s <= 1, in
+ * counts relative to p0.
+ */
+struct segment{
+	float c1;
+	float c2;
+	float c3;
+	float inv_n;
+	int32_t p0;
+	int32_t p1;
+	uint16_t n;			// ticks of the segment
+	uint16_t k;			// ticks commanded so far
+	uint8_t stop;		// velocity 0 at p1
+};
+
+static struct point points[PVT_POINTS];	// queue, only used by the main loop
+static uint8_t head;
+static uint8_t count;
+
+static int32_t last_position;		// end of the last prepared segment
+static int32_t last_velocity;
+
+static struct segment seg;			// running segment, owned by the tick
+static struct segment next;
+static volatile uint8_t next_ready;
+static volatile uint8_t status;
+static volatile uint8_t flush;		// the tick asks the main loop to clear the queue
+
+
+/*
+ * The tick uses compare B of the Timer2 time base that telemetry_init()
+ * sets up, half a tick after the telemetry snapshot.
+ */
+static void tick_enable(uint8_t enable){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		if(enable){
+			OCR2B = OCR2A / 2;
+			TIFR2 = _BV(OCF2B);
+			TIMSK2 |= _BV(OCIE2B);
+		}
+		else{
+			TIMSK2 &= ~_BV(OCIE2B);
+		}
+	}
+}
+
+/*
+ * Hermite segment from the end of the previous one to pt, with the
+ * tangents scaled to the segment time.
+ */
+static void prepare(struct segment* s, const struct point* pt){
+	float t = pt->time / 1000.0;
+	float d = (float)((int64_t)pt->position - last_position);
+	float m0 = last_velocity * t;
+	float m1 = pt->velocity * t;
+	
+	s->c1 = m0;
+	s->c2 = 3.0*d - 2.0*m0 - m1;
+	s->c3 = m0 + m1 - 2.0*d;
+	s->inv_n = 1.0 / pt->time;
+	s->p0 = last_position;
+	s->p1 = pt->position;
+	s->n = pt->time;
+	s->k = 0;
+	s->stop = (pt->velocity == 0);
+	
+	last_position = pt->position;
+	last_velocity = pt->velocity;
+}
+
+/*
+ * Take the oldest queued point, count must not be 0.
+ */
+static const struct point* pop(){
+	uint8_t tail = (head + PVT_POINTS - count) % PVT_POINTS;
+	
+	count--;
+	return &points[tail];
+}
+
+motion_result_t pvt_add(int32_t position, int32_t velocity, uint16_t time){
+	pvt_service();
+	if(count == PVT_POINTS) return MOTION_BUFFER_FULL;
+	if(time == 0 || time > PVT_TIME_MAX) return MOTION_INVALID;
+	if(position < get_softlimit_neg()) return MOTION_BELOW_SOFTLIMIT;
+	if(position > get_softlimit_pos()) return MOTION_ABOVE_SOFTLIMIT;
+	
+	points[head].position = position;
+	points[head].velocity = velocity;
+	points[head].time = time;
+	head = (head + 1) % PVT_POINTS;
+	count++;
+	return MOTION_OK;
+}
+
+motion_result_t pvt_start(){
+	motion_result_t result;
+	
+	pvt_service();
+	if(status == PVT_RUNNING) return MOTION_BUSY;
+	if(count == 0) return MOTION_INVALID;
+	
+	// a refused start leaves the queue as it is
+	result = follow_start();
+	if(result != MOTION_OK) return result;
+	
+	last_position = get_position_cnt();
+	last_velocity = 0;
+	prepare(&seg, pop());
+	next_ready = 0;
+	
+	status = PVT_RUNNING;
+	tick_enable(1);
+	pvt_service();
+	return MOTION_OK;
+}
+
+void pvt_clear(){
+	if(status == PVT_RUNNING){
+		follow_stop();
+		status = PVT_ABORTED;
+		tick_enable(0);
+	}
+	else{
+		status = PVT_IDLE;
+	}
+	count = 0;
+	next_ready = 0;
+	flush = 0;
+}
+
+uint8_t pvt_free(){
+	pvt_service();
+	return PVT_POINTS - count;
+}
+
+uint8_t pvt_status(){
+	return status;
+}
+
+/*
+ * Called from the tick, the motor is already halted.
+ */
+static void finish(uint8_t result){
+	status = result;
+	if(result != PVT_IDLE){
+		flush = 1;
+	}
+	tick_enable(0);
+}
+
+/*
+ * Advance the running trajectory by one tick. Interrupts stay enabled
+ * while the curve is evaluated, so the float math does not delay the
+ * step ISR, follow_target() sets the new target atomically.
+ */
+ISR(TIMER2_COMPB_vect, ISR_NOBLOCK){
+	float s;
+	float delta;
+	
+	if(status != PVT_RUNNING) return;
+	
+	// halted by a limit switch, or soft_stop() has braked to a halt
+	if(get_motor_state() != MOVING){
+		follow_stop();
+		finish(PVT_ABORTED);
+		return;
+	}
+	
+	// :MOT:STOP brakes from the current velocity, the rest is dropped
+	if(follow_braking()){
+		follow_brake();
+		return;
+	}
+	
+	if(seg.k == seg.n){
+		if(next_ready){
+			seg = next;
+			next_ready = 0;
+		}
+		else if(seg.stop){
+			// wait for the last steps, a late point still continues the trajectory
+			if(follow_reached()){
+				follow_stop();
+				finish(PVT_IDLE);
+			}
+			return;
+		}
+		else{
+			follow_stop();
+			finish(PVT_UNDERRUN);
+			return;
+		}
+	}
+	
+	// command the position at the end of the next tick
+	seg.k++;
+	if(seg.k == seg.n){
+		follow_target(seg.p1);
+	}
+	else{
+		s = seg.k * seg.inv_n;
+		delta = s * (seg.c1 + s * (seg.c2 + s * seg.c3));
+		follow_target(seg.p0 + (int32_t)((delta < 0) ? delta - 0.5 : delta + 0.5));
+	}
+}
+
+void pvt_service(){
+	struct segment s;
+	
+	if(flush){
+		flush = 0;
+		count = 0;
+		next_ready = 0;
+	}
+	if(status != PVT_RUNNING || next_ready || count == 0) return;
+	
+	prepare(&s, pop());
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		next = s;
+		next_ready = 1;
+	}
+}
@@ -0,0 +1,186 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Oscillation and raster scans between two positions
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#include <Arduino.h>
+#include <util/delay.h>
+
+#include "scan.h"
+#include "A4988.h"
+#include "pins.h"
+
+enum scan_state{
+	SCAN_IDLE,
+	SCAN_APPROACH,		// moving to start
+	SCAN_PASS,			// moving along a pass
+	SCAN_RETURN,		// raster mode, moving back to start
+	SCAN_DWELL
+};
+
+static uint8_t state = SCAN_IDLE;
+static uint8_t mode = SCAN_OSCILLATE;
+static uint8_t trigger;
+
+static int32_t scan_from;
+static int32_t scan_to;
+static int32_t target;			// target of the running move
+static uint16_t passes;
+static uint16_t passes_done;
+static uint16_t dwell_ms;
+static unsigned long dwell_start;
+
+extern volatile uint8_t MOTION_FLAG;
+
+
+/*
+ * Moves end on a whole microstep, so the target is reached if the
+ * position is less than one microstep away.
+ */
+static uint8_t at_target(){
+	int32_t diff = get_position_cnt() - target;
+	int32_t increment = POSITION_SCALE / MICROSTEPS;
+	
+	return diff < increment && diff > -increment;
+}
+
+static void finish(){
+	state = SCAN_IDLE;
+	MOTION_FLAG = 1;	// completes *OPC and sends the event line
+}
+
+static void move_to(int32_t position, uint8_t next_state){
+	target = position;
+	state = next_state;
+	
+	if(at_target()) return;
+	if(move_absolute_cnt(position) != MOTION_OK){
+		finish();
+	}
+}
+
+/*
+ * Next pass, in oscillation mode alternating between both directions.
+ */
+static void start_pass(){
+	if(mode == SCAN_OSCILLATE && (passes_done & 1)){
+		move_to(scan_from, SCAN_PASS);
+	}
+	else{
+		move_to(scan_to, SCAN_PASS);
+	}
+}
+
+static void turnaround(){
+	if(dwell_ms != 0){
+		dwell_start = millis();
+		state = SCAN_DWELL;
+	}
+	else{
+		start_pass();
+	}
+}
+
+motion_result_t scan_start(int32_t start, int32_t stop, uint16_t count, uint16_t dwell){
+	if(get_motor_state() == MOVING) return MOTION_BUSY;
+	if(start == stop || count == 0) return MOTION_INVALID;
+	if(start < get_softlimit_neg() || stop < get_softlimit_neg()) return MOTION_BELOW_SOFTLIMIT;
+	if(start > get_softlimit_pos() || stop > get_softlimit_pos()) return MOTION_ABOVE_SOFTLIMIT;
+	
+	scan_from = start;
+	scan_to = stop;
+	passes = count;
+	passes_done = 0;
+	dwell_ms = dwell;
+	
+	move_to(start, SCAN_APPROACH);
+	return MOTION_OK;
+}
+
+void scan_stop(){
+	if(state != SCAN_IDLE){
+		finish();
+	}
+}
+
+void scan_set_mode(uint8_t new_mode){
+	mode = new_mode;
+}
+
+uint8_t scan_get_mode(){
+	return mode;
+}
+
+void scan_set_trigger(uint8_t enable){
+	trigger = enable;
+	PIN_LOW(PIN_TRIGGER);
+	if(enable){
+		PIN_OUTPUT(PIN_TRIGGER);
+	}
+	else{
+		PIN_INPUT(PIN_TRIGGER);
+	}
+}
+
+uint8_t scan_get_trigger(){
+	return trigger;
+}
+
+uint8_t scan_running(){
+	return state != SCAN_IDLE;
+}
+
+uint16_t scan_passes_done(){
+	return passes_done;
+}
+
+uint16_t scan_passes(){
+	return passes;
+}
+
+void scan_service(){
+	if(state == SCAN_IDLE) return;
+	
+	if(state == SCAN_DWELL){
+		if(get_motor_state() == MOVING){
+			finish();
+		}
+		else if(millis() - dwell_start >= dwell_ms){
+			start_pass();
+		}
+		return;
+	}
+	
+	if(get_motor_state() == MOVING) return;
+	
+	if(!at_target()){
+		finish();
+		return;
+	}
+	
+	switch(state){
+		case SCAN_APPROACH:
+		case SCAN_RETURN:
+			turnaround();
+			break;
+			
+		case SCAN_PASS:
+			if(trigger){
+				PIN_HIGH(PIN_TRIGGER);
+				_delay_us(SCAN_TRIGGER_US);
+				PIN_LOW(PIN_TRIGGER);
+			}
+			
+			if(++passes_done == passes){
+				finish();
+			}
+			else if(mode == SCAN_RASTER){
+				move_to(scan_from, SCAN_RETURN);
+			}
+			else{
+				turnaround();
+			}
+			break;
+	}
+}
@@ -4,19 +4,391 @@
  * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
  */
  
+#include <ctype.h>
+#include <math.h>
+#include <string.h>
 #include <scpiparser.h>
 #include "scpi_functions.h"
 #include "A4988.h"
+#include "uart.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "profile.h"
+#include "nvm.h"
+#include "units.h"
+#include "pvt.h"
+#include "scan.h"
+#include "macro.h"
+#include "sequence.h"
+
+static const char err_motor_busy[] PROGMEM = "Command error: Motor busy";
+static const char err_below_softlimit[] PROGMEM = "Command error: Position below negative softlimit";
+static const char err_above_softlimit[] PROGMEM = "Command error: Position above positive softlimit";
+static const char err_invalid_unit[] PROGMEM = "Command error: Invalid unit";
+static const char err_missing_parameter[] PROGMEM = "Missing parameter";
+static const char err_out_of_range[] PROGMEM = "Data out of range";
+static const char err_illegal_value[] PROGMEM = "Illegal parameter value";
+static const char err_memory_lost[] PROGMEM = "Save/recall memory lost";
+static const char err_buffer_full[] PROGMEM = "Command error: Trajectory buffer full";
+static const char err_no_trajectory[] PROGMEM = "Command error: No trajectory points";
+static const char err_macro_running[] PROGMEM = "Command error: Macro running";
+static const char err_unknown_macro[] PROGMEM = "Macro error: Unknown macro";
+static const char err_undefined_header[] PROGMEM = "Undefined header";
+static const char err_out_of_memory[] PROGMEM = "Out of memory";
+static const char err_list_armed[] PROGMEM = "Command error: Position list armed";
+static const char err_list_empty[] PROGMEM = "Command error: Position list empty";
+
+static const char state_moving[] PROGMEM = "MOVING";
+static const char state_stopped[] PROGMEM = "STOPPED";
+static const char state_limit_pos[] PROGMEM = "LIM+";
+static const char state_limit_neg[] PROGMEM = "LIM-";
+static const char state_fault[] PROGMEM = "FAULT";
+
+#define ESR_OPC 0x01	// operation complete bit of the event status register
+#define HOME_DISTANCE 40000L	// full steps of a home run, shortened at the softlimit
+
+static uint8_t event_status;	// event status register, read and cleared by *ESR?
+static uint8_t opc_pending;		// *OPC received while the motor was moving
+static uint8_t events_enabled;	// send unsolicited event lines
+
+void queue_error(int id, const char* description){
+  scpi_error error;
+  error.id = id;
+  error.description = description;
+  error.length = strlen_P(description);
+  scpi_queue_error(&ctx, error);
+}
+
+
+/**
+ * Turn a refused move into the matching SCPI error.
+ */
+static void report_motion_result(motion_result_t result){
+  switch(result){
+    case MOTION_BUSY:
+      scpi_print_int(-300);
+      scpi_puts_P(PSTR("->"));
+      scpi_puts_P(err_motor_busy);
+      scpi_putc('\n');
+      queue_error(-300, err_motor_busy);
+      break;
+
+    case MOTION_BELOW_SOFTLIMIT:
+      queue_error(-301, err_below_softlimit);
+      break;
+
+    case MOTION_ABOVE_SOFTLIMIT:
+      queue_error(-302, err_above_softlimit);
+      break;
+
+    case MOTION_BUFFER_FULL:
+      queue_error(-303, err_buffer_full);
+      break;
+
+    case MOTION_INVALID:
+      queue_error(-304, err_no_trajectory);
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+ * Turn a refused macro command into the matching SCPI error.
+ */
+static void report_macro_result(macro_result_t result){
+  switch(result){
+    case MACRO_BUSY:
+      queue_error(-305, err_macro_running);
+      break;
+
+    case MACRO_UNKNOWN:
+      queue_error(-180, err_unknown_macro);
+      break;
+
+    case MACRO_FULL:
+      queue_error(-225, err_out_of_memory);
+      break;
+
+    case MACRO_UNDEFINED:
+      queue_error(-113, err_undefined_header);
+      break;
+
+    case MACRO_INVALID:
+      queue_error(-224, err_illegal_value);
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+ * Name of the current motor state in flash, as reported by STATE?.
+ */
+static const char* state_name(){
+  if(get_motor_state() == MOVING){
+    return state_moving;
+  }
+
+  switch(get_switch_state()){
+    case FREE:
+      return state_stopped;
+
+    case LIMIT_POS:
+      return state_limit_pos;
+
+    case LIMIT_NEG:
+      return state_limit_neg;
+
+    default:
+      return state_fault;
+  }
+}
+
+/**
+ * Compare an argument with a keyword in its short and long form, both in
+ * program memory.
+ */
+static uint8_t match_keyword(struct scpi_token* arg, const char* short_form, const char* long_form){
+  size_t short_len = strlen_P(short_form);
+  size_t long_len = strlen_P(long_form);
+
+  return (arg->length == short_len && !strncasecmp_P(arg->value, short_form, short_len))
+      || (arg->length == long_len && !strncasecmp_P(arg->value, long_form, long_len));
+}
+
+/**
+ * Split a unit suffix off arg. Returns the unit and the length of the
+ * number in front of it, UNIT_STEP if there is no suffix.
+ */
+static uint8_t split_unit(struct scpi_token* arg, size_t* length){
+  size_t number_length = arg->length;
+
+  while(number_length > 0 && isalpha(arg->value[number_length-1])){
+    number_length--;
+  }
+
+  *length = number_length;
+  if(number_length == arg->length){
+    return UNIT_STEP;
+  }
+
+  return units_lookup(arg->value + number_length, arg->length - number_length);
+}
+
+/**
+ * Parse the first argument of command into a fixed point integer with
+ * scale units per full step (or per unit for plain integers). MINimum,
+ * MAXimum and DEFault select min_value, max_value and default_value,
+ * plain decimal numbers take the integer fast path, exponents fall back
+ * to scpi_parse_numeric(). If physical is set, numbers with a unit of
+ * the axis scale are converted exactly with integer arithmetic. Returns
+ * 0 and queues an error if the argument is missing, carries an invalid
+ * unit or lies outside min_value..max_value.
+ */
+static uint8_t parse_argument(struct scpi_token* command, uint8_t physical, int32_t scale, int32_t default_value, int32_t min_value, int32_t max_value, int32_t* value){
+  struct scpi_token* args;
+  struct scpi_numeric output_numeric;
+  size_t number_length;
+  uint8_t unit;
+  int32_t base;
+  args = command;
+
+  while(args != NULL && args->type == 0){
+    args = args->next;
+  }
+
+  if(args == NULL){
+    queue_error(-109, err_missing_parameter);
+    return 0;
+  }
+
+  if(match_keyword(args, PSTR("MIN"), PSTR("MINIMUM"))){
+    *value = min_value;
+  }
+  else if(match_keyword(args, PSTR("MAX"), PSTR("MAXIMUM"))){
+    *value = max_value;
+  }
+  else if(match_keyword(args, PSTR("DEF"), PSTR("DEFAULT"))){
+    *value = default_value;
+  }
+  else if(physical && (unit = split_unit(args, &number_length)) != UNIT_STEP){
+    if(!units_compatible(unit)){
+      queue_error(-200, err_invalid_unit);
+      return 0;
+    }
+
+    if(!scpi_parse_fixed(args->value, number_length, units_base_per_unit(unit), &base)){
+      queue_error(-224, err_illegal_value);
+      return 0;
+    }
+
+    if(!units_to_steps(base, scale, value)){
+      queue_error(-222, err_out_of_range);
+      return 0;
+    }
+  }
+  else if(!scpi_parse_fixed(args->value, args->length, scale, value)){
+    output_numeric = scpi_parse_numeric(args->value, args->length, 0, 0, 0);
 
-float softlimit_pos = INT_MAX;
-float softlimit_neg = INT_MIN;
+    if(output_numeric.length != 0){
+      queue_error(-200, err_invalid_unit);
+      return 0;
+    }
+
+    if(fabs(output_numeric.value * scale) >= INT_MAX){
+      queue_error(-222, err_out_of_range);
+      return 0;
+    }
+
+    *value = (int32_t)lround(output_numeric.value * scale);
+  }
+
+  if(*value < min_value || *value > max_value){
+    queue_error(-222, err_out_of_range);
+    return 0;
+  }
+
+  return 1;
+}
+
+
+/*
+ * Motor parameters, one descriptor per parameter. Values are integers
+ * in units of 1/scale, the set and query handlers are generated by
+ * PARAMETER_HANDLERS() below.
+ */
+struct parameter{
+  int32_t scale;
+  int32_t default_value;
+  int32_t min_value;
+  int32_t max_value;
+  int32_t (*get)();
+  void (*set)(int32_t value);
+};
+
+static int32_t get_speed_param(){ return get_speed_limit(); }
+static void set_speed_param(int32_t value){ set_max_speed((uint16_t)value); }
+static int32_t get_acceleration_param(){ return get_acceleration(); }
+static void set_acceleration_param(int32_t value){ set_acceleration((uint16_t)value); }
+static int32_t get_deceleration_param(){ return get_deceleration(); }
+static void set_deceleration_param(int32_t value){ set_deceleration((uint16_t)value); }
+static void set_position_param(int32_t value){ set_position_cnt(value); nvm_position_confirmed(); }
+
+enum{
+  PARAM_SPEED,
+  PARAM_ACCELERATION,
+  PARAM_DECELERATION,
+  PARAM_SOFTLIMIT_POS,
+  PARAM_SOFTLIMIT_NEG,
+  PARAM_POSITION
+};
+
+static const struct parameter parameters[] PROGMEM = {
+  /* scale, default, min, max, getter, setter */
+  {1,              200,     10,      800,     get_speed_param,        set_speed_param},
+  {1,              100,     10,      400,     get_acceleration_param, set_acceleration_param},
+  {1,              100,     10,      400,     get_deceleration_param, set_deceleration_param},
+  {POSITION_SCALE, INT_MAX, INT_MIN, INT_MAX, get_softlimit_pos,      set_softlimit_pos},
+  {POSITION_SCALE, INT_MIN, INT_MIN, INT_MAX, get_softlimit_neg,      set_softlimit_neg},
+  {POSITION_SCALE, 0,       INT_MIN, INT_MAX, get_position_cnt,       set_position_param},
+};
+
+static scpi_error_t set_parameter(uint8_t index, struct scpi_token* command){
+  struct parameter param;
+  int32_t value;
+
+  memcpy_P(&param, &parameters[index], sizeof(param));
+
+  if(parse_argument(command, 1, param.scale, param.default_value, param.min_value, param.max_value, &value)){
+    param.set(value);
+  }
+
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+/**
+ * Print a value in base units in the report unit.
+ */
+static void print_physical(int32_t base){
+  if(units_get_report() == UNIT_UM){
+    scpi_print_int(base);
+  }
+  else{
+    scpi_print_fixed(base, units_base_per_unit(units_get_report()), 3);
+  }
+}
+
+static scpi_error_t get_parameter(uint8_t index, struct scpi_token* command){
+  struct parameter param;
+
+  memcpy_P(&param, &parameters[index], sizeof(param));
+
+  if(units_get_report() != UNIT_STEP){
+    print_physical(units_from_steps(param.get(), param.scale));
+  }
+  else if(param.scale == 1){
+    scpi_print_int(param.get());
+  }
+  else{
+    scpi_print_fixed(param.get(), param.scale, 2);
+  }
+  scpi_putc('\n');
+
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+#define PARAMETER_HANDLERS(set_handler, get_handler, index) \
+  scpi_error_t set_handler(struct scpi_parser_context* context, struct scpi_token* command){ \
+    return set_parameter(index, command); \
+  } \
+  scpi_error_t get_handler(struct scpi_parser_context* context, struct scpi_token* command){ \
+    return get_parameter(index, command); \
+  }
+
+PARAMETER_HANDLERS(scpi_set_max_speed, scpi_get_speed_limit, PARAM_SPEED)
+PARAMETER_HANDLERS(scpi_set_acceleration, scpi_get_acceleration, PARAM_ACCELERATION)
+PARAMETER_HANDLERS(scpi_set_deceleration, scpi_get_deceleration, PARAM_DECELERATION)
+PARAMETER_HANDLERS(scpi_set_softlimit_pos, scpi_get_softlimit_pos, PARAM_SOFTLIMIT_POS)
+PARAMETER_HANDLERS(scpi_set_softlimit_neg, scpi_get_softlimit_neg, PARAM_SOFTLIMIT_NEG)
+PARAMETER_HANDLERS(scpi_set_position, scpi_get_position, PARAM_POSITION)
 
 
 /**
  * Respond to *IDN?
  */
 scpi_error_t identify(struct scpi_parser_context* context, struct scpi_token* command){
-  response_len = snprintf(response_buffer, BUF_LEN, "BLiX Stepper Motor Controller rev. 1.0\n");
+  scpi_puts_P(PSTR("BLiX Stepper Motor Controller rev. 1.0\n"));
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+/**
+ * 
+ */
+scpi_error_t scpi_soft_stop(struct scpi_parser_context* context, struct scpi_token* command){
+  macro_stop();
+  sequence_stop();
+  scan_stop();
+  soft_stop();
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+/**
+ * 
+ */
+scpi_error_t scpi_move_relative(struct scpi_parser_context* context, struct scpi_token* command){
+  int32_t distance;
+
+  if(parse_argument(command, 1, POSITION_SCALE, 0, INT_MIN, INT_MAX, &distance)){
+    report_motion_result(move_relative_cnt(distance));
+  }
+
   scpi_free_tokens(command);
   return SCPI_SUCCESS;
 }
@@ -24,445 +396,980 @@ scpi_error_t identify(struct scpi_parser_context* context, struct scpi_token* co
 /**
  * 
  */
-scpi_error_t scpi_get_position(struct scpi_parser_context* context, struct scpi_token* command){
-  response_len = snprintf(response_buffer, BUF_LEN, "%.2f\n", (double)(get_position()));
+scpi_error_t scpi_move_absolute(struct scpi_parser_context* context, struct scpi_token* command){
+  int32_t target;
+
+  if(!parse_argument(command, 1, POSITION_SCALE, 0, INT_MIN, INT_MAX, &target)){
+    scpi_free_tokens(command);
+    return SCPI_SUCCESS;
+  }
+  
+  if(get_motor_state() == MOVING){
+	soft_stop();
+  }
+  
+  else{
+	report_motion_result(move_absolute_cnt(target));
+  }
+
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+/**
+ * Respond with the number of dropped and stalled transmit bytes.
+ */
+scpi_error_t scpi_get_tx_statistics(struct scpi_parser_context* context, struct scpi_token* command){
+  scpi_print_int((int32_t)uart_tx_dropped());
+  scpi_putc(',');
+  scpi_print_int((int32_t)uart_tx_stalled());
+  scpi_putc('\n');
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+
+/**
+ * Switch the baud rate after the pending responses are sent. An optional
+ * second argument SAVE stores the rate as power-on rate.
+ */
+scpi_error_t scpi_set_baud(struct scpi_parser_context* context, struct scpi_token* command){
+  struct scpi_token* args;
+  int32_t value;
+
+  if(!parse_argument(command, 0, 1, UART_DEFAULT_BAUD, 9600, 1000000, &value)){
+    scpi_free_tokens(command);
+    return SCPI_SUCCESS;
+  }
+
+  if(!uart_baud_supported((uint32_t)value)){
+    queue_error(-224, err_illegal_value);
+    scpi_free_tokens(command);
+    return SCPI_SUCCESS;
+  }
+
+  args = command;
+  while(args != NULL && args->type == 0){
+    args = args->next;
+  }
+  args = args->next;
+
+  if(args != NULL){
+    if(args->length == 4 && !strncasecmp_P(args->value, PSTR("SAVE"), 4)){
+      uart_save_baud((uint32_t)value);
+    }
+    else{
+      queue_error(-224, err_illegal_value);
+      scpi_free_tokens(command);
+      return SCPI_SUCCESS;
+    }
+  }
+
+  uart_set_baud((uint32_t)value);
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+
+scpi_error_t scpi_get_baud(struct scpi_parser_context* context, struct scpi_token* command){
+  scpi_print_int((int32_t)uart_get_baud());
+  scpi_putc('\n');
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+
+scpi_error_t scpi_home_pos(struct scpi_parser_context* context, struct scpi_token* command){
+  //home_run_pos();
+  report_motion_result(move_clamped_cnt(HOME_DISTANCE * POSITION_SCALE));
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+
+scpi_error_t scpi_home_neg(struct scpi_parser_context* context, struct scpi_token* command){
+  //home_run_neg();
+  report_motion_result(move_clamped_cnt(-HOME_DISTANCE * POSITION_SCALE));
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+
+/**
+ * Start streaming telemetry records at the given rate in Hz, 0 stops.
+ */
+scpi_error_t scpi_set_stream(struct scpi_parser_context* context, struct scpi_token* command){
+  int32_t value;
+
+  if(parse_argument(command, 0, 1, 0, 0, TELEMETRY_RATE_MAX, &value)){
+    telemetry_start((uint16_t)value);
+  }
+
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+
+scpi_error_t scpi_get_stream(struct scpi_parser_context* context, struct scpi_token* command){
+  scpi_print_int(telemetry_rate());
+  scpi_putc('\n');
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+
+/**
+ * Record every n-th step of the following moves, 0 disables tracing.
+ */
+scpi_error_t scpi_set_trace_decimation(struct scpi_parser_context* context, struct scpi_token* command){
+  int32_t value;
+
+  if(parse_argument(command, 0, 1, 0, 0, 255, &value)){
+    trace_set_decimation((uint8_t)value);
+  }
+
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+
+scpi_error_t scpi_get_trace_decimation(struct scpi_parser_context* context, struct scpi_token* command){
+  scpi_print_int(trace_decimation);
+  scpi_putc('\n');
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+
+/**
+ * Respond with "stored,recorded", recorded counts overwritten samples too.
+ */
+scpi_error_t scpi_get_trace_count(struct scpi_parser_context* context, struct scpi_token* command){
+  scpi_print_int(trace_count());
+  scpi_putc(',');
+  scpi_print_int((int32_t)trace_recorded());
+  scpi_putc('\n');
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+
+/**
+ * The block is too large for response_buffer, so earlier responses of
+ * the message are sent first and the block goes straight to the UART.
+ */
+scpi_error_t scpi_get_trace_data(struct scpi_parser_context* context, struct scpi_token* command){
+  if(response_len > 0){
+    response_buffer[response_len-1] = ';';
+    uart_write(response_buffer, response_len);
+    response_len = 0;
+  }
+
+  trace_dump();
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+
+/**
+ * Set the axis scale, "<full steps>,<distance><MM|UM|DEG>", or remove it
+ * with DEFault.
+ */
+scpi_error_t scpi_set_scale(struct scpi_parser_context* context, struct scpi_token* command){
+  struct scpi_token* args;
+  int32_t counts;
+  int32_t base;
+  size_t number_length;
+  uint8_t unit;
+
+  args = command;
+  while(args != NULL && args->type == 0){
+    args = args->next;
+  }
+
+  if(args != NULL && match_keyword(args, PSTR("DEF"), PSTR("DEFAULT"))){
+    units_set_scale(0, 0, UNIT_STEP);
+    scpi_free_tokens(command);
+    return SCPI_SUCCESS;
+  }
+
+  if(args == NULL || args->next == NULL){
+    queue_error(-109, err_missing_parameter);
+    scpi_free_tokens(command);
+    return SCPI_SUCCESS;
+  }
+
+  unit = split_unit(args->next, &number_length);
+
+  if(unit == UNIT_STEP || unit == UNIT_INVALID){
+    queue_error(-200, err_invalid_unit);
+  }
+  else if(!scpi_parse_fixed(args->value, args->length, POSITION_SCALE, &counts)
+      || !scpi_parse_fixed(args->next->value, number_length, units_base_per_unit(unit), &base)){
+    queue_error(-224, err_illegal_value);
+  }
+  else if(!units_set_scale(counts, base, unit)){
+    queue_error(-222, err_out_of_range);
+  }
+
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+
+/**
+ * Respond with "<full steps>,<distance><unit>", or "0" without scale.
+ */
+scpi_error_t scpi_get_scale(struct scpi_parser_context* context, struct scpi_token* command){
+  int32_t counts;
+  int32_t base;
+  uint8_t axis;
+
+  units_get_scale(&counts, &base, &axis);
+
+  if(axis == UNIT_STEP){
+    scpi_putc('0');
+  }
+  else{
+    scpi_print_fixed(counts, POSITION_SCALE, 2);
+    scpi_putc(',');
+    scpi_print_fixed(base, 1000, 3);
+    scpi_puts_P(axis == UNIT_DEG ? PSTR("DEG") : PSTR("MM"));
+  }
+  scpi_putc('\n');
+
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+
+/**
+ * Select the unit of position, speed and limit queries, STEP, MM, UM
+ * or DEG.
+ */
+scpi_error_t scpi_set_unit(struct scpi_parser_context* context, struct scpi_token* command){
+  struct scpi_token* args;
+  uint8_t unit;
+
+  args = command;
+  while(args != NULL && args->type == 0){
+    args = args->next;
+  }
+
+  if(args == NULL){
+    queue_error(-109, err_missing_parameter);
+  }
+  else{
+    if(args->length == 4 && !strncasecmp_P(args->value, PSTR("STEP"), 4)){
+      unit = UNIT_STEP;
+    }
+    else{
+      unit = units_lookup(args->value, args->length);
+    }
+
+    if(!units_set_report(unit)){
+      queue_error(-224, err_illegal_value);
+    }
+  }
+
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+
+scpi_error_t scpi_get_unit(struct scpi_parser_context* context, struct scpi_token* command){
+  switch(units_get_report()){
+    case UNIT_MM:
+      scpi_puts_P(PSTR("MM\n"));
+      break;
+
+    case UNIT_UM:
+      scpi_puts_P(PSTR("UM\n"));
+      break;
+
+    case UNIT_DEG:
+      scpi_puts_P(PSTR("DEG\n"));
+      break;
+
+    default:
+      scpi_puts_P(PSTR("STEP\n"));
+      break;
+  }
+
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+/**
+ * Respond with the driver the firmware was built for and the position
+ * counts per full step, e.g. "DRV8825,32".
+ */
+scpi_error_t scpi_get_driver(struct scpi_parser_context* context, struct scpi_token* command){
+  scpi_puts_P(PSTR(DRIVER_NAME ","));
+  scpi_print_int(POSITION_SCALE);
+  scpi_putc('\n');
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+
+/**
+ * Queue a trajectory point "<position>,<velocity>,<time>". Position in
+ * full steps, velocity in full steps per second, both may carry a unit
+ * of the axis scale, time in ms since the previous point.
+ */
+scpi_error_t scpi_add_pvt(struct scpi_parser_context* context, struct scpi_token* command){
+  struct scpi_token* args;
+  int32_t position;
+  int32_t velocity;
+  int32_t time;
+
+  args = command;
+  while(args != NULL && args->type == 0){
+    args = args->next;
+  }
+
+  if(parse_argument(args, 1, POSITION_SCALE, 0, INT_MIN, INT_MAX, &position)
+      && parse_argument(args->next, 1, POSITION_SCALE, 0, INT_MIN, INT_MAX, &velocity)
+      && parse_argument(args->next->next, 0, 1, 1, 1, PVT_TIME_MAX, &time)){
+    report_motion_result(pvt_add(position, velocity, (uint16_t)time));
+  }
+
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+scpi_error_t scpi_start_pvt(struct scpi_parser_context* context, struct scpi_token* command){
+  report_motion_result(pvt_start());
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+scpi_error_t scpi_clear_pvt(struct scpi_parser_context* context, struct scpi_token* command){
+  pvt_clear();
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+/**
+ * Respond with the number of free trajectory point slots.
+ */
+scpi_error_t scpi_get_pvt_free(struct scpi_parser_context* context, struct scpi_token* command){
+  scpi_print_int(pvt_free());
+  scpi_putc('\n');
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+/**
+ * Respond with IDLE, RUNNING, UNDERRUN or ABORTED.
+ */
+scpi_error_t scpi_get_pvt_state(struct scpi_parser_context* context, struct scpi_token* command){
+  switch(pvt_status()){
+    case PVT_RUNNING:
+      scpi_puts_P(PSTR("RUNNING\n"));
+      break;
+
+    case PVT_UNDERRUN:
+      scpi_puts_P(PSTR("UNDERRUN\n"));
+      break;
+
+    case PVT_ABORTED:
+      scpi_puts_P(PSTR("ABORTED\n"));
+      break;
+
+    default:
+      scpi_puts_P(PSTR("IDLE\n"));
+      break;
+  }
+
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+
+/**
+ * Start a scan "<start>,<stop>,<passes>[,<dwell>]", positions in full
+ * steps or a unit of the axis scale, dwell in ms.
+ */
+scpi_error_t scpi_start_scan(struct scpi_parser_context* context, struct scpi_token* command){
+  struct scpi_token* args;
+  int32_t start;
+  int32_t stop;
+  int32_t passes;
+  int32_t dwell = 0;
+
+  args = command;
+  while(args != NULL && args->type == 0){
+    args = args->next;
+  }
+
+  if(parse_argument(args, 1, POSITION_SCALE, 0, INT_MIN, INT_MAX, &start)
+      && parse_argument(args->next, 1, POSITION_SCALE, 0, INT_MIN, INT_MAX, &stop)
+      && parse_argument(args->next->next, 0, 1, 1, 1, 65535, &passes)
+      && (args->next->next->next == NULL
+          || parse_argument(args->next->next->next, 0, 1, 0, 0, 65535, &dwell))){
+    if(start == stop){
+      queue_error(-224, err_illegal_value);
+    }
+    else{
+      report_motion_result(scan_start(start, stop, (uint16_t)passes, (uint16_t)dwell));
+    }
+  }
+
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+scpi_error_t scpi_set_scan_mode(struct scpi_parser_context* context, struct scpi_token* command){
+  struct scpi_token* args;
+  args = command;
+
+  while(args != NULL && args->type == 0){
+    args = args->next;
+  }
+
+  if(args == NULL){
+    queue_error(-109, err_missing_parameter);
+  }
+  else if(match_keyword(args, PSTR("OSC"), PSTR("OSCILLATE"))){
+    scan_set_mode(SCAN_OSCILLATE);
+  }
+  else if(match_keyword(args, PSTR("RAST"), PSTR("RASTER"))){
+    scan_set_mode(SCAN_RASTER);
+  }
+  else{
+    queue_error(-224, err_illegal_value);
+  }
+
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+scpi_error_t scpi_get_scan_mode(struct scpi_parser_context* context, struct scpi_token* command){
+  if(scan_get_mode() == SCAN_RASTER){
+    scpi_puts_P(PSTR("RAST\n"));
+  }
+  else{
+    scpi_puts_P(PSTR("OSC\n"));
+  }
+
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+scpi_error_t scpi_set_scan_trigger(struct scpi_parser_context* context, struct scpi_token* command){
+  struct scpi_token* args;
+  args = command;
+
+  while(args != NULL && args->type == 0){
+    args = args->next;
+  }
+
+  if(args == NULL){
+    queue_error(-109, err_missing_parameter);
+  }
+  else if((args->length == 2 && !strncasecmp_P(args->value, PSTR("ON"), 2))
+      || (args->length == 1 && args->value[0] == '1')){
+    scan_set_trigger(1);
+  }
+  else if((args->length == 3 && !strncasecmp_P(args->value, PSTR("OFF"), 3))
+      || (args->length == 1 && args->value[0] == '0')){
+    scan_set_trigger(0);
+  }
+  else{
+    queue_error(-224, err_illegal_value);
+  }
+
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+scpi_error_t scpi_get_scan_trigger(struct scpi_parser_context* context, struct scpi_token* command){
+  scpi_putc(scan_get_trigger() ? '1' : '0');
+  scpi_putc('\n');
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+/**
+ * Respond with "<passes done>,<passes>,<running>".
+ */
+scpi_error_t scpi_get_scan_progress(struct scpi_parser_context* context, struct scpi_token* command){
+  scpi_print_int(scan_passes_done());
+  scpi_putc(',');
+  scpi_print_int(scan_passes());
+  scpi_putc(',');
+  scpi_putc(scan_running() ? '1' : '0');
+  scpi_putc('\n');
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+
+/**
+ * Append positions "<pos>[,<pos>...]" to the position list, in full
+ * steps or a unit of the axis scale. Stops at the first refused one.
+ */
+scpi_error_t scpi_add_list(struct scpi_parser_context* context, struct scpi_token* command){
+  struct scpi_token* args;
+  int32_t position;
+  motion_result_t result = MOTION_OK;
+
+  args = command;
+  while(args != NULL && args->type == 0){
+    args = args->next;
+  }
+
+  if(args == NULL){
+    queue_error(-109, err_missing_parameter);
+  }
+
+  for(; args != NULL && result == MOTION_OK; args = args->next){
+    if(!parse_argument(args, 1, POSITION_SCALE, 0, INT_MIN, INT_MAX, &position)) break;
+
+    result = sequence_add(position);
+    if(result == MOTION_BUSY){
+      queue_error(-306, err_list_armed);
+    }
+    else if(result == MOTION_BUFFER_FULL){
+      queue_error(-225, err_out_of_memory);
+    }
+  }
+
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+scpi_error_t scpi_clear_list(struct scpi_parser_context* context, struct scpi_token* command){
+  sequence_clear();
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+scpi_error_t scpi_start_list(struct scpi_parser_context* context, struct scpi_token* command){
+  motion_result_t result = sequence_start();
+
+  if(result == MOTION_INVALID){
+    queue_error(-307, err_list_empty);
+  }
+  else{
+    report_motion_result(result);
+  }
+
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+scpi_error_t scpi_stop_list(struct scpi_parser_context* context, struct scpi_token* command){
+  sequence_stop();
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+scpi_error_t scpi_set_list_edge(struct scpi_parser_context* context, struct scpi_token* command){
+  struct scpi_token* args;
+  args = command;
+
+  while(args != NULL && args->type == 0){
+    args = args->next;
+  }
+
+  if(args == NULL){
+    queue_error(-109, err_missing_parameter);
+  }
+  else if(match_keyword(args, PSTR("RIS"), PSTR("RISING"))){
+    sequence_set_edge(SEQUENCE_RISING);
+  }
+  else if(match_keyword(args, PSTR("FALL"), PSTR("FALLING"))){
+    sequence_set_edge(SEQUENCE_FALLING);
+  }
+  else{
+    queue_error(-224, err_illegal_value);
+  }
+
   scpi_free_tokens(command);
   return SCPI_SUCCESS;
 }
 
-/**
- * 
- */
-scpi_error_t scpi_get_acceleration(struct scpi_parser_context* context, struct scpi_token* command){
-  response_len = snprintf(response_buffer, BUF_LEN, "%d\n", get_acceleration());
+scpi_error_t scpi_get_list_edge(struct scpi_parser_context* context, struct scpi_token* command){
+  if(sequence_get_edge() == SEQUENCE_FALLING){
+    scpi_puts_P(PSTR("FALL\n"));
+  }
+  else{
+    scpi_puts_P(PSTR("RIS\n"));
+  }
+
   scpi_free_tokens(command);
   return SCPI_SUCCESS;
 }
 
-/**
- * 
- */
-scpi_error_t scpi_get_deceleration(struct scpi_parser_context* context, struct scpi_token* command){
-  response_len = snprintf(response_buffer, BUF_LEN, "%d\n", get_deceleration());
+scpi_error_t scpi_get_list_count(struct scpi_parser_context* context, struct scpi_token* command){
+  scpi_print_int(sequence_count());
+  scpi_putc('\n');
   scpi_free_tokens(command);
   return SCPI_SUCCESS;
 }
 
-/**
- * 
- */
-scpi_error_t scpi_get_softlimit_neg(struct scpi_parser_context* context, struct scpi_token* command){
-  response_len = snprintf(response_buffer, BUF_LEN, "%.2f\n", (double)(softlimit_neg));
+scpi_error_t scpi_get_list_index(struct scpi_parser_context* context, struct scpi_token* command){
+  scpi_print_int(sequence_index());
+  scpi_putc('\n');
   scpi_free_tokens(command);
   return SCPI_SUCCESS;
 }
 
-/**
- * 
- */
-scpi_error_t scpi_get_softlimit_pos(struct scpi_parser_context* context, struct scpi_token* command){
-  response_len = snprintf(response_buffer, BUF_LEN, "%.2f\n", (double)(softlimit_pos));
+scpi_error_t scpi_get_list_overruns(struct scpi_parser_context* context, struct scpi_token* command){
+  scpi_print_int(sequence_overruns());
+  scpi_putc('\n');
   scpi_free_tokens(command);
   return SCPI_SUCCESS;
 }
 
-/**
- * 
- */
-scpi_error_t scpi_soft_stop(struct scpi_parser_context* context, struct scpi_token* command){
-  soft_stop();
+scpi_error_t scpi_get_list_state(struct scpi_parser_context* context, struct scpi_token* command){
+  if(sequence_armed()){
+    scpi_puts_P(PSTR("ARMED\n"));
+  }
+  else{
+    scpi_puts_P(PSTR("IDLE\n"));
+  }
+
   scpi_free_tokens(command);
   return SCPI_SUCCESS;
 }
 
+
 /**
- * 
+ * Strip the quotes of a string argument, unquoted strings are taken as
+ * they are.
  */
-scpi_error_t scpi_get_speed_limit(struct scpi_parser_context* context, struct scpi_token* command){
-  response_len = snprintf(response_buffer, BUF_LEN, "%d\n", get_speed_limit());
-  scpi_free_tokens(command);
-  return SCPI_SUCCESS;
+static void unquote(const char** value, size_t* length){
+  if(*length >= 2 && (*value)[0] == '"' && (*value)[*length-1] == '"'){
+    (*value)++;
+    *length -= 2;
+  }
 }
 
 /**
- * 
+ * Define or extend a macro "<name>,\"<cmd>;<cmd>;...\"". The body spans
+ * all remaining arguments, as the parser also splits quoted strings at
+ * commas.
  */
-scpi_error_t scpi_move_relative(struct scpi_parser_context* context, struct scpi_token* command){
+static void define_macro(struct scpi_parser_context* context, struct scpi_token* command, uint8_t append){
   struct scpi_token* args;
-  struct scpi_numeric output_numeric;
-  args = command;
+  struct scpi_token* last;
+  const char* name;
+  const char* body;
+  size_t name_length;
+  size_t length;
 
+  args = command;
   while(args != NULL && args->type == 0){
     args = args->next;
   }
 
-  float output_value;
-  output_numeric = scpi_parse_numeric(args->value, args->length, 0, 0, 0);
-  
-  if(get_motor_state() != STOPPED){
-	scpi_error error;
-	error.id = -300;
-	error.description = "Command error: Motor busy";
-	error.length = 25;
-	response_len = snprintf(response_buffer, BUF_LEN, "%d->%s\n", error.id, error.description);
-	scpi_queue_error(&ctx, error);
-	scpi_free_tokens(command);
-	return SCPI_SUCCESS;
+  if(args == NULL || args->next == NULL){
+    queue_error(-109, err_missing_parameter);
+    return;
   }
-  
-  if(output_numeric.length == 0){
-    output_value = output_numeric.value;
-    
-    if(output_value + get_position() < softlimit_neg){
-		scpi_error error;
-		error.id = -301;
-		error.description = "Command error: Position below negative softlimit";
-		error.length = 48;
-		scpi_queue_error(&ctx, error);
-		scpi_free_tokens(command);
-		return SCPI_SUCCESS;
-	}
-	
-	if(output_value + get_position() > softlimit_pos){
-		scpi_error error;
-		error.id = -302;
-		error.description = "Command error: Position above positive softlimit";
-		error.length = 48;
-		scpi_queue_error(&ctx, error);
-		scpi_free_tokens(command);
-		return SCPI_SUCCESS;
-	}
-	
-	else{
-		move_relative(output_value);
-		scpi_free_tokens(command);
-		return SCPI_SUCCESS;
-	}
 
-  }
+  name = args->value;
+  name_length = args->length;
+  unquote(&name, &name_length);
 
-  else{
-    scpi_error error;
-    error.id = -200;
-    error.description = "Command error: Invalid unit";
-    error.length = 27;
-    scpi_queue_error(&ctx, error);
-    scpi_free_tokens(command);
-    return SCPI_SUCCESS;
-  }
+  // the tokens point into the message, the body is the rest of it
+  for(last = args->next; last->next != NULL; last = last->next);
+  body = args->next->value;
+  length = last->value + last->length - body;
+  unquote(&body, &length);
+
+  report_macro_result(macro_define(context, name, name_length, body, length, append));
+}
+
+scpi_error_t scpi_define_macro(struct scpi_parser_context* context, struct scpi_token* command){
+  define_macro(context, command, 0);
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+scpi_error_t scpi_append_macro(struct scpi_parser_context* context, struct scpi_token* command){
+  define_macro(context, command, 1);
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
 }
 
 /**
- * 
+ * Run a macro "<name>[,<loops>]".
  */
-scpi_error_t scpi_move_absolute(struct scpi_parser_context* context, struct scpi_token* command){
+scpi_error_t scpi_run_macro(struct scpi_parser_context* context, struct scpi_token* command){
   struct scpi_token* args;
-  struct scpi_numeric output_numeric;
-  args = command;
+  const char* name;
+  size_t name_length;
+  int32_t count = 1;
 
+  args = command;
   while(args != NULL && args->type == 0){
     args = args->next;
   }
 
-  float output_value;
-  output_numeric = scpi_parse_numeric(args->value, args->length, 0, 0, 0);
-  
-  if(get_motor_state() == MOVING){
-	soft_stop();
+  if(args == NULL){
+    queue_error(-109, err_missing_parameter);
   }
-  
-  if(output_numeric.length == 0){
-    output_value = output_numeric.value;
-    
-    if(output_value < softlimit_neg){
-		scpi_error error;
-		error.id = -301;
-		error.description = "Command error: Position below negative softlimit";
-		error.length = 48;
-		scpi_queue_error(&ctx, error);
-		scpi_free_tokens(command);
-		return SCPI_SUCCESS;
-	}
-	
-	if(output_value > softlimit_pos){
-		scpi_error error;
-		error.id = -302;
-		error.description = "Command error: Position above positive softlimit";
-		error.length = 48;
-		scpi_queue_error(&ctx, error);
-		scpi_free_tokens(command);
-		return SCPI_SUCCESS;
-	}
-	
-	else{
-		move_relative(output_value - get_position());
-		scpi_free_tokens(command);
-		return SCPI_SUCCESS;
-	}
-
+  else if(args->next == NULL || parse_argument(args->next, 0, 1, 1, 1, 65535, &count)){
+    name = args->value;
+    name_length = args->length;
+    unquote(&name, &name_length);
+    report_macro_result(macro_run(name, name_length, (uint16_t)count));
   }
 
-  else{
-    scpi_error error;
-    error.id = -200;
-    error.description = "Command error: Invalid unit";
-    error.length = 27;
-    scpi_queue_error(&ctx, error);
-    scpi_free_tokens(command);
-    return SCPI_SUCCESS;
-  }
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
 }
 
-/**
- * 
- */
-scpi_error_t scpi_set_acceleration(struct scpi_parser_context* context, struct scpi_token* command){
+scpi_error_t scpi_stop_macro(struct scpi_parser_context* context, struct scpi_token* command){
+  macro_stop();
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+scpi_error_t scpi_delete_macro(struct scpi_parser_context* context, struct scpi_token* command){
   struct scpi_token* args;
-  struct scpi_numeric output_numeric;
-  args = command;
+  const char* name;
+  size_t name_length;
 
+  args = command;
   while(args != NULL && args->type == 0){
     args = args->next;
   }
 
-  float output_value;
-  output_numeric = scpi_parse_numeric(args->value, args->length, 100, 10, 400);
-  
-  if(output_numeric.length == 0){
-    output_value = output_numeric.value;
-
+  if(args == NULL){
+    queue_error(-109, err_missing_parameter);
   }
-
   else{
-    scpi_error error;
-    error.id = -200;
-    error.description = "Command error: Invalid unit";
-    error.length = 27;
-    scpi_queue_error(&ctx, error);
-    scpi_free_tokens(command);
-    return SCPI_SUCCESS;
+    name = args->value;
+    name_length = args->length;
+    unquote(&name, &name_length);
+    report_macro_result(macro_delete(name, name_length));
   }
 
-  set_acceleration((uint16_t)(output_value));
   scpi_free_tokens(command);
   return SCPI_SUCCESS;
 }
 
 /**
- * 
+ * Respond with the quoted names of all macros, "" if there are none.
  */
-scpi_error_t scpi_set_deceleration(struct scpi_parser_context* context, struct scpi_token* command){
-  struct scpi_token* args;
-  struct scpi_numeric output_numeric;
-  args = command;
-
-  while(args != NULL && args->type == 0){
-    args = args->next;
+scpi_error_t scpi_get_macro_catalog(struct scpi_parser_context* context, struct scpi_token* command){
+  const char* name;
+  uint8_t found = 0;
+  uint8_t i;
+  uint8_t j;
+
+  for(i = 0; i < MACRO_COUNT; i++){
+    name = macro_name(i);
+    if(name == NULL) continue;
+
+    if(found++) scpi_putc(',');
+    scpi_putc('"');
+    for(j = 0; j < MACRO_NAME_MAX && name[j] != 0; j++){
+      scpi_putc(name[j]);
+    }
+    scpi_putc('"');
   }
 
-  float output_value;
-  output_numeric = scpi_parse_numeric(args->value, args->length, 100, 10, 400);
-  
-  if(output_numeric.length == 0){
-    output_value = output_numeric.value;
+  if(!found){
+    scpi_puts_P(PSTR("\"\""));
   }
+  scpi_putc('\n');
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+/**
+ * Respond with "<loops done>,<loops>,<running>".
+ */
+scpi_error_t scpi_get_macro_progress(struct scpi_parser_context* context, struct scpi_token* command){
+  scpi_print_int(macro_loops_done());
+  scpi_putc(',');
+  scpi_print_int(macro_loops());
+  scpi_putc(',');
+  scpi_putc(macro_running() ? '1' : '0');
+  scpi_putc('\n');
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
 
-  else{
-    scpi_error error;
-    error.id = -200;
-    error.description = "Command error: Invalid unit";
-    error.length = 27;
-    scpi_queue_error(&ctx, error);
-    scpi_free_tokens(command);
-    return SCPI_SUCCESS;
-  }
 
-  set_deceleration((uint16_t)(output_value));
+/**
+ * Respond with 1 if the position counter is trustworthy after startup.
+ */
+scpi_error_t scpi_get_position_valid(struct scpi_parser_context* context, struct scpi_token* command){
+  scpi_putc(nvm_position_trusted() ? '1' : '0');
+  scpi_putc('\n');
   scpi_free_tokens(command);
   return SCPI_SUCCESS;
 }
 
+
 /**
- * 
+ * Store the motor settings in profile slot 0 to NVM_PROFILES-1.
  */
-scpi_error_t scpi_set_max_speed(struct scpi_parser_context* context, struct scpi_token* command){
-  struct scpi_token* args;
-  struct scpi_numeric output_numeric;
-  args = command;
+scpi_error_t scpi_save_profile(struct scpi_parser_context* context, struct scpi_token* command){
+  int32_t slot;
 
-  while(args != NULL && args->type == 0){
-    args = args->next;
+  if(parse_argument(command, 0, 1, 0, 0, NVM_PROFILES - 1, &slot)){
+    nvm_save_profile((uint8_t)slot);
   }
 
-  float output_value;
-  output_numeric = scpi_parse_numeric(args->value, args->length, 200, 10, 800);
-  
-  if(output_numeric.length == 0){
-    output_value = output_numeric.value;
-  }
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
 
-  else{
-    scpi_error error;
-    error.id = -200;
-    error.description = "Command error: Invalid unit";
-    error.length = 27;
-    scpi_queue_error(&ctx, error);
-    scpi_free_tokens(command);
-    return SCPI_SUCCESS;
+
+scpi_error_t scpi_recall_profile(struct scpi_parser_context* context, struct scpi_token* command){
+  int32_t slot;
+
+  if(parse_argument(command, 0, 1, 0, 0, NVM_PROFILES - 1, &slot)){
+    if(!nvm_recall_profile((uint8_t)slot)){
+      queue_error(-314, err_memory_lost);
+    }
   }
 
-  set_max_speed((uint16_t)(output_value));
   scpi_free_tokens(command);
   return SCPI_SUCCESS;
 }
 
-/**
- * 
- */
-scpi_error_t scpi_set_softlimit_pos(struct scpi_parser_context* context, struct scpi_token* command){
-  struct scpi_token* args;
-  struct scpi_numeric output_numeric;
-  args = command;
 
-  while(args != NULL && args->type == 0){
-    args = args->next;
-  }
+#ifdef PROFILE
+scpi_error_t scpi_get_profile(struct scpi_parser_context* context, struct scpi_token* command){
+  profile_report();
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
 
-  float output_value;
-  output_numeric = scpi_parse_numeric(args->value, args->length, softlimit_pos, 0, 5);
-  
-  if(output_numeric.length == 0){
-    output_value = output_numeric.value;
-  }
 
-  else{
-    scpi_error error;
-    error.id = -200;
-    error.description = "Command error: Invalid unit";
-    error.length = 27;
-    scpi_queue_error(&ctx, error);
+scpi_error_t scpi_reset_profile(struct scpi_parser_context* context, struct scpi_token* command){
+  profile_reset();
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+#endif
+
+
+scpi_error_t scpi_get_state(struct scpi_parser_context* context, struct scpi_token* command){
+    scpi_puts_P(state_name());
+    scpi_putc('\n');
+  
     scpi_free_tokens(command);
     return SCPI_SUCCESS;
+}
+
+
+uint8_t scpi_operation_pending(){
+  return get_motor_state() == MOVING || scan_running() || macro_running();
+}
+
+
+scpi_error_t scpi_operation_complete(struct scpi_parser_context* context, struct scpi_token* command){
+  if(scpi_operation_pending()){
+    opc_pending = 1;
+  }
+  else{
+    event_status |= ESR_OPC;
   }
 
-  softlimit_pos = output_value;
   scpi_free_tokens(command);
   return SCPI_SUCCESS;
 }
 
-/**
- * 
- */
-scpi_error_t scpi_set_softlimit_neg(struct scpi_parser_context* context, struct scpi_token* command){
-  struct scpi_token* args;
-  struct scpi_numeric output_numeric;
-  args = command;
 
-  while(args != NULL && args->type == 0){
-    args = args->next;
+scpi_error_t scpi_operation_complete_query(struct scpi_parser_context* context, struct scpi_token* command){
+  if(scpi_operation_pending()){
+    scpi_suspend(context);
   }
-
-  float output_value;
-  output_numeric = scpi_parse_numeric(args->value, args->length, softlimit_neg, 0, 5);
-  
-  if(output_numeric.length == 0){
-    output_value = output_numeric.value;
+  else{
+    scpi_puts_P(PSTR("1\n"));
   }
 
-  else{
-    scpi_error error;
-    error.id = -200;
-    error.description = "Command error: Invalid unit";
-    error.length = 27;
-    scpi_queue_error(&ctx, error);
-    scpi_free_tokens(command);
-    return SCPI_SUCCESS;
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+
+scpi_error_t scpi_wait(struct scpi_parser_context* context, struct scpi_token* command){
+  if(scpi_operation_pending()){
+    scpi_suspend(context);
   }
 
-  softlimit_neg = output_value;
   scpi_free_tokens(command);
   return SCPI_SUCCESS;
 }
 
 
-/**
- * 
- */
-scpi_error_t scpi_set_position(struct scpi_parser_context* context, struct scpi_token* command){
+scpi_error_t scpi_get_event_status(struct scpi_parser_context* context, struct scpi_token* command){
+  scpi_print_int(event_status);
+  scpi_putc('\n');
+  event_status = 0;
+  scpi_free_tokens(command);
+  return SCPI_SUCCESS;
+}
+
+
+scpi_error_t scpi_set_events(struct scpi_parser_context* context, struct scpi_token* command){
   struct scpi_token* args;
-  struct scpi_numeric output_numeric;
   args = command;
 
   while(args != NULL && args->type == 0){
     args = args->next;
   }
 
-  float output_value;
-  output_numeric = scpi_parse_numeric(args->value, args->length, get_position(), 0, 0);
-  
-  if(output_numeric.length == 0){
-    output_value = output_numeric.value;
+  if(args == NULL){
+    queue_error(-109, err_missing_parameter);
+  }
+  else if((args->length == 2 && !strncasecmp_P(args->value, PSTR("ON"), 2))
+      || (args->length == 1 && args->value[0] == '1')){
+    events_enabled = 1;
+  }
+  else if((args->length == 3 && !strncasecmp_P(args->value, PSTR("OFF"), 3))
+      || (args->length == 1 && args->value[0] == '0')){
+    events_enabled = 0;
   }
-
   else{
-    scpi_error error;
-    error.id = -200;
-    error.description = "Command error: Invalid unit";
-    error.length = 27;
-    scpi_queue_error(&ctx, error);
-    scpi_free_tokens(command);
-    return SCPI_SUCCESS;
+    queue_error(-224, err_illegal_value);
   }
 
-  set_position(output_value);
   scpi_free_tokens(command);
   return SCPI_SUCCESS;
 }
 
 
-scpi_error_t scpi_home_pos(struct scpi_parser_context* context, struct scpi_token* command){
-  //home_run_pos();
-  move_relative(40000);
+scpi_error_t scpi_get_events(struct scpi_parser_context* context, struct scpi_token* command){
+  scpi_putc(events_enabled ? '1' : '0');
+  scpi_putc('\n');
   scpi_free_tokens(command);
   return SCPI_SUCCESS;
 }
 
 
-scpi_error_t scpi_home_neg(struct scpi_parser_context* context, struct scpi_token* command){
-  //home_run_neg();
-  move_relative(-40000);
-  scpi_free_tokens(command);
-  return SCPI_SUCCESS;
-}
+void scpi_motion_event(){
+  char line[10];
+  uint8_t len;
 
+  if(scpi_operation_pending()){
+    return;
+  }
 
-scpi_error_t scpi_get_state(struct scpi_parser_context* context, struct scpi_token* command){
-    if(get_motor_state() == MOVING){
-        response_len = snprintf(response_buffer, BUF_LEN, "MOVING\n");
-    }
-    
-    else{
-        switch_state_t tmp = get_switch_state();
-        
-        if(tmp == FREE){
-            response_len = snprintf(response_buffer, BUF_LEN, "STOPPED\n");
-        }
-        
-        else if(tmp == LIMIT_POS){
-            response_len = snprintf(response_buffer, BUF_LEN, "LIM+\n");
-        }
-        
-        else if(tmp == LIMIT_NEG){
-            response_len = snprintf(response_buffer, BUF_LEN, "LIM-\n");
-        }
-        
-        else{
-            response_len = snprintf(response_buffer, BUF_LEN, "FAULT\n");
-        }
-    }
-  
-    scpi_free_tokens(command);
-    return SCPI_SUCCESS;
+  if(opc_pending){
+    opc_pending = 0;
+    event_status |= ESR_OPC;
+  }
+
+  if(events_enabled){
+    line[0] = '!';
+    strcpy_P(line + 1, state_name());
+    len = strlen(line);
+    line[len++] = '\n';
+    uart_write(line, len);
+  }
 }
 
 /**
@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Position list advanced by an external trigger
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "sequence.h"
+#include "A4988.h"
+#include "pins.h"
+
+static int32_t points[SEQUENCE_POINTS];
+static uint8_t count;
+static uint8_t edge = SEQUENCE_RISING;
+
+/* shared with the INT1 ISR */
+static volatile uint8_t armed;
+static volatile uint8_t next_entry;		// index of the next entry
+static volatile uint8_t planned;		// plan holds the move to points[next_entry]
+static volatile uint16_t overruns;
+static move_plan_t plan;
+
+
+/*
+ * INT1 on the selected edge, at reset it would trigger on a low level.
+ */
+static void select_edge(){
+	EICRA &= ~(_BV(ISC11) | _BV(ISC10));
+	EICRA |= (edge == SEQUENCE_FALLING) ? _BV(ISC11) : (_BV(ISC11) | _BV(ISC10));
+}
+
+static void disarm(){
+	EIMSK &= ~_BV(INT1);
+	armed = 0;
+	planned = 0;
+}
+
+/*
+ * The plan is only read here while planned is set, the main loop only
+ * writes it while planned is clear.
+ */
+ISR(INT1_vect){
+	if(!armed) return;
+	
+	if(!planned){
+		overruns++;
+		return;
+	}
+	planned = 0;
+	
+	switch(start_plan(&plan)){
+		case MOTION_OK:
+			next_entry++;
+			break;
+			
+		case MOTION_LIMIT_SWITCH:
+			disarm();
+			break;
+			
+		default:
+			// moving or moved since planning, sequence_service() plans again
+			overruns++;
+			break;
+	}
+}
+
+motion_result_t sequence_add(int32_t position){
+	if(armed) return MOTION_BUSY;
+	if(count == SEQUENCE_POINTS) return MOTION_BUFFER_FULL;
+	
+	points[count++] = position;
+	return MOTION_OK;
+}
+
+void sequence_clear(){
+	sequence_stop();
+	count = 0;
+	next_entry = 0;
+}
+
+motion_result_t sequence_start(){
+	uint8_t i;
+	
+	if(count == 0) return MOTION_INVALID;
+	
+	for(i = 0; i < count; i++){
+		if(points[i] < get_softlimit_neg()) return MOTION_BELOW_SOFTLIMIT;
+		if(points[i] > get_softlimit_pos()) return MOTION_ABOVE_SOFTLIMIT;
+	}
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		next_entry = 0;
+		overruns = 0;
+		planned = 0;
+		armed = 1;
+		select_edge();
+		EIFR = _BV(INTF1);		// drop an edge seen before arming
+		EIMSK |= _BV(INT1);
+	}
+	return MOTION_OK;
+}
+
+void sequence_stop(){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		disarm();
+	}
+}
+
+void sequence_set_edge(uint8_t new_edge){
+	edge = new_edge;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		if(armed){
+			select_edge();
+			EIFR = _BV(INTF1);
+		}
+	}
+}
+
+uint8_t sequence_get_edge(){
+	return edge;
+}
+
+uint8_t sequence_armed(){
+	return armed;
+}
+
+uint8_t sequence_index(){
+	return next_entry;
+}
+
+uint8_t sequence_count(){
+	return count;
+}
+
+uint16_t sequence_overruns(){
+	uint16_t n;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		n = overruns;
+	}
+	return n;
+}
+
+void sequence_service(){
+	motion_result_t result;
+	
+	if(!armed || get_motor_state() == MOVING) return;
+	if(planned && plan.start == get_position_cnt()) return;
+	
+	planned = 0;
+	
+	// a trigger may have started the next move since the checks above
+	if(get_motor_state() == MOVING) return;
+	
+	if(next_entry == count){
+		sequence_stop();
+		return;
+	}
+	
+	result = plan_move_cnt(points[next_entry], &plan);
+	if(result == MOTION_OK){
+		planned = 1;
+	}
+	else if(result != MOTION_BUSY){
+		sequence_stop();
+	}
+}
@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Periodic position/velocity telemetry records
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "telemetry.h"
+#include "A4988.h"
+#include "uart.h"
+
+static volatile uint16_t period;		// ticks per record, 0 if not streaming
+static volatile uint16_t countdown;
+static volatile uint8_t pending;		// a snapshot waits for the main loop
+
+/* snapshot taken by the Timer2 ISR */
+static volatile int32_t snap_position;
+static volatile int32_t snap_delta;		// position change since the previous snapshot
+static volatile uint8_t snap_state;
+static volatile uint8_t snap_switch;
+static int32_t last_position;
+
+
+void telemetry_init(){
+    TCCR2A = _BV(WGM21);				// CTC mode
+    TCCR2B = _BV(CS22) | _BV(CS20);		// prescaler 128
+    OCR2A = F_CPU / 128 / TELEMETRY_TICK_HZ - 1;
+    TIMSK2 &= ~_BV(OCIE2A);
+}
+
+void telemetry_tick_update(){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        if(period != 0){
+            TIMSK2 |= _BV(OCIE2A);
+        }
+        else{
+            TIMSK2 &= ~_BV(OCIE2A);
+        }
+    }
+}
+
+void telemetry_start(uint16_t rate){
+    if(rate == 0){
+        telemetry_stop();
+        return;
+    }
+    if(rate > TELEMETRY_RATE_MAX){
+        rate = TELEMETRY_RATE_MAX;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        period = TELEMETRY_TICK_HZ / rate;
+        countdown = period;
+        pending = 0;
+        last_position = get_position_cnt();
+    }
+    telemetry_tick_update();
+}
+
+void telemetry_stop(){
+    period = 0;
+    pending = 0;
+    telemetry_tick_update();
+}
+
+uint16_t telemetry_rate(){
+    if(period == 0) return 0;
+
+    return TELEMETRY_TICK_HZ / period;
+}
+
+/*
+ * Interrupts do not nest, so the step ISR cannot change the motor
+ * between the reads below and every snapshot is consistent.
+ */
+ISR(TIMER2_COMPA_vect){
+    int32_t position;
+
+    if(period == 0 || --countdown != 0) return;
+    countdown = period;
+
+    position = get_position_cnt();
+    snap_position = position;
+    snap_delta = position - last_position;
+    snap_state = get_motor_state();
+    snap_switch = get_switch_state();
+    last_position = position;
+    pending = 1;
+}
+
+static char* put_int(char* p, int32_t value){
+    char digits[10];
+    uint8_t n = 0;
+    uint32_t u;
+
+    if(value < 0){
+        *p++ = '-';
+        u = -(uint32_t)value;
+    }
+    else{
+        u = value;
+    }
+
+    do{
+        digits[n++] = '0' + u % 10;
+        u /= 10;
+    } while(u != 0);
+
+    while(n > 0){
+        *p++ = digits[--n];
+    }
+    return p;
+}
+
+void telemetry_service(){
+    char record[32];
+    char* p;
+    int32_t position;
+    int32_t delta;
+    uint8_t state;
+    uint8_t sw;
+    uint16_t ticks;
+
+    if(!pending) return;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        position = snap_position;
+        delta = snap_delta;
+        state = snap_state;
+        sw = snap_switch;
+        ticks = period;
+        pending = 0;
+    }
+    if(ticks == 0) return;
+
+    p = record;
+    *p++ = '=';
+    p = put_int(p, position);
+    *p++ = ',';
+    p = put_int(p, delta * TELEMETRY_TICK_HZ / ticks);
+    *p++ = ',';
+    *p++ = '0' + state;
+    *p++ = ',';
+    *p++ = '0' + sw;
+    *p++ = '\n';
+
+    uart_try_write(record, p - record);
+}
@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Motion trace recorder
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include "trace.h"
+#include "uart.h"
+
+#if TRACE_LEN * TRACE_SAMPLE_SIZE > 999
+#error "trace_dump() supports blocks up to 999 bytes"
+#endif
+
+struct trace_entry{
+    uint16_t step;
+    uint16_t interval;
+    uint8_t phase;
+};
+
+volatile uint8_t trace_decimation;
+
+static struct trace_entry trace_buf[TRACE_LEN];
+static volatile uint8_t trace_head;		// next sample written
+static volatile uint8_t trace_stored;
+static volatile uint32_t trace_total;
+static volatile uint8_t trace_paused;	// set while trace_dump() reads the buffer
+
+
+void trace_sample(uint16_t step, uint16_t interval, uint8_t phase){
+    struct trace_entry* entry;
+
+    if(trace_paused) return;
+
+    entry = &trace_buf[trace_head];
+    entry->step = step;
+    entry->interval = interval;
+    entry->phase = phase;
+
+    trace_head = (trace_head + 1) % TRACE_LEN;
+    if(trace_stored < TRACE_LEN){
+        trace_stored++;
+    }
+    trace_total++;
+}
+
+void trace_clear(){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        trace_head = 0;
+        trace_stored = 0;
+        trace_total = 0;
+    }
+}
+
+void trace_set_decimation(uint8_t decimation){
+    trace_decimation = decimation;
+}
+
+uint8_t trace_count(){
+    return trace_stored;
+}
+
+uint32_t trace_recorded(){
+    uint32_t total;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        total = trace_total;
+    }
+    return total;
+}
+
+void trace_dump(){
+    char header[6];
+    uint8_t sample[TRACE_SAMPLE_SIZE];
+    uint16_t length;
+    uint8_t index;
+    uint8_t n;
+    uint8_t i;
+
+    trace_paused = 1;
+
+    n = trace_stored;
+    index = (trace_head + TRACE_LEN - n) % TRACE_LEN;
+    length = (uint16_t)n * TRACE_SAMPLE_SIZE;
+
+    /* "#" followed by the number of length digits and the length */
+    header[0] = '#';
+    if(length >= 100){
+        header[1] = '3';
+        header[2] = '0' + length / 100;
+        header[3] = '0' + length / 10 % 10;
+        header[4] = '0' + length % 10;
+        i = 5;
+    }
+    else if(length >= 10){
+        header[1] = '2';
+        header[2] = '0' + length / 10;
+        header[3] = '0' + length % 10;
+        i = 4;
+    }
+    else{
+        header[1] = '1';
+        header[2] = '0' + length;
+        i = 3;
+    }
+    uart_write(header, i);
+
+    while(n--){
+        sample[0] = trace_buf[index].step;
+        sample[1] = trace_buf[index].step >> 8;
+        sample[2] = trace_buf[index].interval;
+        sample[3] = trace_buf[index].interval >> 8;
+        sample[4] = trace_buf[index].phase;
+        uart_write((const char*)sample, TRACE_SAMPLE_SIZE);
+        index = (index + 1) % TRACE_LEN;
+    }
+    uart_write("\n", 1);
+
+    trace_paused = 0;
+}
@@ -0,0 +1,373 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Interrupt driven UART for the SCPI command line
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+#include <Arduino.h>
+
+#include "uart.h"
+#include "binproto.h"
+
+static volatile char rx_buf[UART_RX_BUF_LEN];
+static volatile uint8_t rx_head;		// next write position of the ISR
+static volatile uint8_t rx_tail;		// next read position of the main loop
+static volatile uint8_t rx_line_start;	// start of the line currently received
+static volatile uint8_t rx_line_len;
+static volatile uint8_t rx_lines;		// complete lines in the buffer
+static volatile uint8_t rx_dropped;
+static volatile uint8_t rx_discard;		// skip the rest of an overlong line
+
+static volatile uint8_t frame_buf[UART_FRAME_SLOTS][BINPROTO_FRAME_MAX];
+static volatile uint8_t frame_head;		// next slot written by the ISR
+static volatile uint8_t frame_tail;		// next slot read by the main loop
+static volatile uint8_t frame_count;
+static uint8_t frame_active;			// a binary frame is being received
+static uint8_t frame_store;				// a slot was free at its sync byte
+static uint8_t frame_pos;
+static uint8_t frame_len;				// opcode, payload and CRC
+static uint8_t frame_byte_at;			// low byte of millis() at the last frame byte
+
+static volatile char tx_buf[UART_TX_BUF_LEN];
+static volatile uint8_t tx_head;		// next write position of the main loop
+static volatile uint8_t tx_tail;		// next read position of the ISR
+static uint8_t tx_written;				// anything sent since uart_init()
+static uint32_t tx_dropped;
+static uint32_t tx_stalled;
+
+static uint32_t baud_rate;
+static uint32_t baud_pending;			// 0 if no change is pending
+static uint8_t baud_confirmed;			// a line was received at the current rate
+static uint8_t baud_timeout;			// fall back on silence, only after uart_set_baud()
+static volatile uint8_t rx_frame_error;
+static unsigned long baud_changed_at;
+
+static const uint32_t supported_baud[] PROGMEM = {9600, 115200, 250000, 500000, 1000000};
+
+EEMEM uint32_t ee_baud = 0xFFFFFFFF;
+
+
+/*
+ * Use double speed mode, it gives the smaller baud rate error for all
+ * common rates at 16 MHz. 250000, 500000 and 1000000 baud divide 16 MHz
+ * exactly, 115200 baud is off by 2.1 %.
+ */
+static void uart_set_rate(uint32_t baud){
+    UCSR0A = _BV(U2X0);
+    UBRR0 = (uint16_t)((F_CPU / 4 / baud - 1) / 2);
+    
+    baud_rate = baud;
+    baud_confirmed = (baud == UART_DEFAULT_BAUD);
+    baud_changed_at = millis();
+    rx_frame_error = 0;
+}
+
+void uart_init(uint32_t baud){
+    UCSR0B = 0x00;
+    uart_set_rate(baud);
+    UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);		// 8-N-1
+    
+    baud_pending = 0;
+    baud_timeout = 0;
+    
+    rx_head = 0;
+    rx_tail = 0;
+    rx_line_start = 0;
+    rx_line_len = 0;
+    rx_lines = 0;
+    rx_dropped = 0;
+    rx_discard = 0;
+    frame_head = 0;
+    frame_tail = 0;
+    frame_count = 0;
+    frame_active = 0;
+    tx_head = 0;
+    tx_tail = 0;
+    tx_written = 0;
+    
+    UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0);
+}
+
+static inline uint8_t rx_next(uint8_t index){
+    return (index + 1 == UART_RX_BUF_LEN) ? 0 : index + 1;
+}
+
+/*
+ * Drop the line currently received and skip everything up to its line
+ * feed.
+ */
+static inline void rx_drop_line(){
+    rx_head = rx_line_start;
+    rx_line_len = 0;
+    rx_discard = 1;
+}
+
+/*
+ * Collect the bytes of a binary frame. The frame length follows from
+ * the opcode, frames with an unknown opcode are discarded. A frame that
+ * found no free slot at its sync byte is received to its end but not
+ * stored, the unread frames stay intact.
+ */
+static inline void rx_frame_byte(uint8_t c){
+    if(frame_pos == 0){
+        uint8_t len = binproto_payload_len(c);
+        
+        if(len == 0xFF){
+            frame_active = 0;
+            return;
+        }
+        frame_len = len + 2;
+    }
+    
+    if(frame_store){
+        frame_buf[frame_head][frame_pos] = c;
+    }
+    frame_pos++;
+    
+    if(frame_pos == frame_len){
+        frame_active = 0;
+        
+        if(frame_store){
+            frame_head = (frame_head + 1 == UART_FRAME_SLOTS) ? 0 : frame_head + 1;
+            frame_count++;
+        }
+    }
+}
+
+/*
+ * Assemble lines in the receive ring buffer. The main loop only sees
+ * a line after its line feed has been received. A sync byte at the
+ * start of a line starts a binary frame instead. A frame that pauses
+ * for more than UART_FRAME_TIMEOUT_MS lost a byte, it is abandoned and
+ * the byte after the pause is taken as text again.
+ */
+ISR(USART_RX_vect){
+    if(bit_is_set(UCSR0A, FE0)) rx_frame_error = 1;
+    
+    char c = UDR0;
+    uint8_t next = rx_next(rx_head);
+    uint8_t now = (uint8_t)millis();
+    
+    if(frame_active){
+        if((uint8_t)(now - frame_byte_at) <= UART_FRAME_TIMEOUT_MS){
+            frame_byte_at = now;
+            rx_frame_byte((uint8_t)c);
+            return;
+        }
+        frame_active = 0;
+    }
+    
+    if((uint8_t)c == BINPROTO_SYNC && rx_line_len == 0 && !rx_discard){
+        frame_active = 1;
+        frame_store = (frame_count < UART_FRAME_SLOTS);
+        frame_pos = 0;
+        frame_byte_at = now;
+        return;
+    }
+    
+    if(c == '\n'){
+        if(rx_discard){
+            rx_discard = 0;
+            rx_dropped++;
+            return;
+        }
+        
+        if(next == rx_tail){
+            // no room for the terminator
+            rx_drop_line();
+            rx_discard = 0;
+            rx_dropped++;
+            return;
+        }
+        
+        rx_buf[rx_head] = c;
+        rx_head = next;
+        rx_line_start = next;
+        rx_line_len = 0;
+        rx_lines++;
+        return;
+    }
+    
+    if(rx_discard) return;
+    
+    if(rx_line_len == UART_LINE_MAX || next == rx_tail){
+        rx_drop_line();
+        return;
+    }
+    
+    rx_buf[rx_head] = c;
+    rx_head = next;
+    rx_line_len++;
+}
+
+int16_t uart_read_line(char* buf, uint8_t size){
+    uint8_t len = 0;
+    uint8_t tail;
+    char c;
+    
+    if(rx_lines == 0) return -1;
+    
+    tail = rx_tail;
+    while((c = rx_buf[tail]) != '\n'){
+        if(len < size) buf[len++] = c;
+        tail = rx_next(tail);
+    }
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        rx_tail = rx_next(tail);
+        rx_lines--;
+    }
+    
+    if(!rx_frame_error) baud_confirmed = 1;
+    return len;
+}
+
+uint8_t uart_read_frame(uint8_t* buf){
+    uint8_t i;
+    
+    if(frame_count == 0) return 0;
+    
+    for(i = 0; i < BINPROTO_FRAME_MAX; i++){
+        buf[i] = frame_buf[frame_tail][i];
+    }
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        frame_tail = (frame_tail + 1 == UART_FRAME_SLOTS) ? 0 : frame_tail + 1;
+        frame_count--;
+    }
+    
+    if(!rx_frame_error) baud_confirmed = 1;
+    return 1;
+}
+
+uint8_t uart_dropped_lines(){
+    uint8_t dropped;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        dropped = rx_dropped;
+        rx_dropped = 0;
+    }
+    return dropped;
+}
+
+/*
+ * Feed the next byte of the transmit ring buffer to the UART and
+ * disable the interrupt once the buffer ran empty.
+ */
+ISR(USART_UDRE_vect){
+    if(tx_head == tx_tail){
+        UCSR0B &= ~_BV(UDRIE0);
+        return;
+    }
+    
+    UCSR0A |= _BV(TXC0);	// clear transmit complete for uart_flush()
+    UDR0 = tx_buf[tx_tail];
+    tx_tail = (tx_tail + 1) & (UART_TX_BUF_LEN - 1);
+}
+
+uint8_t uart_tx_free(){
+    return (UART_TX_BUF_LEN - 1) - ((tx_head - tx_tail) & (UART_TX_BUF_LEN - 1));
+}
+
+static inline void tx_put(char c){
+    tx_buf[tx_head] = c;
+    tx_head = (tx_head + 1) & (UART_TX_BUF_LEN - 1);
+    tx_written = 1;
+}
+
+void uart_write(const char* buf, uint8_t len){
+    while(len--){
+        if(uart_tx_free() == 0){
+            tx_stalled++;
+            while(uart_tx_free() == 0);
+        }
+        tx_put(*buf++);
+        UCSR0B |= _BV(UDRIE0);
+    }
+}
+
+uint8_t uart_try_write(const char* buf, uint8_t len){
+    if(uart_tx_free() < len){
+        tx_dropped += len;
+        return 0;
+    }
+    
+    while(len--){
+        tx_put(*buf++);
+    }
+    UCSR0B |= _BV(UDRIE0);
+    return 1;
+}
+
+void uart_flush(){
+    if(!tx_written) return;
+    
+    while(tx_head != tx_tail);
+    loop_until_bit_is_set(UCSR0A, TXC0);
+}
+
+uint32_t uart_tx_dropped(){
+    return tx_dropped;
+}
+
+uint32_t uart_tx_stalled(){
+    return tx_stalled;
+}
+
+uint8_t uart_baud_supported(uint32_t baud){
+    uint8_t i;
+    
+    for(i = 0; i < sizeof(supported_baud)/sizeof(supported_baud[0]); i++){
+        if(pgm_read_dword(&supported_baud[i]) == baud) return 1;
+    }
+    return 0;
+}
+
+void uart_set_baud(uint32_t baud){
+    baud_pending = baud;
+}
+
+uint32_t uart_get_baud(){
+    return baud_rate;
+}
+
+void uart_save_baud(uint32_t baud){
+    eeprom_update_block(&baud, &ee_baud, sizeof(baud));
+}
+
+uint32_t uart_power_on_baud(){
+    uint32_t baud;
+    
+    eeprom_read_block(&baud, &ee_baud, sizeof(baud));
+    return uart_baud_supported(baud) ? baud : UART_DEFAULT_BAUD;
+}
+
+/*
+ * Switch the rate only after the transmitter ran empty, so that the
+ * response to the baud command still goes out at the old rate. A rate
+ * that the host cannot use shows up as framing errors or silence, in
+ * both cases the driver returns to the default rate. A stored power-on
+ * rate only falls back on framing errors, the host may connect late.
+ */
+void uart_service(){
+    if(baud_pending != 0){
+        if(tx_head != tx_tail) return;
+        if(tx_written && bit_is_clear(UCSR0A, TXC0)) return;
+        
+        uart_set_rate(baud_pending);
+        baud_pending = 0;
+        baud_timeout = 1;
+        return;
+    }
+    
+    if(!baud_confirmed){
+        if(rx_frame_error || (baud_timeout && millis() - baud_changed_at > UART_BAUD_CONFIRM_MS)){
+            uart_set_rate(UART_DEFAULT_BAUD);
+        }
+    }
+}
@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Conversion between physical units and position counts
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+
+#include "units.h"
+#include "A4988.h"
+
+static int32_t scale_counts;			// 0 if the axis has no scale
+static int32_t scale_base;
+static uint8_t scale_axis = UNIT_STEP;
+static uint8_t report_unit = UNIT_STEP;
+
+
+/*
+ * Division rounded to the nearest integer, half away from zero.
+ * divisor must be positive.
+ */
+static int64_t div_round(int64_t dividend, int64_t divisor){
+	if(dividend < 0){
+		return -((-dividend + divisor / 2) / divisor);
+	}
+	return (dividend + divisor / 2) / divisor;
+}
+
+uint8_t units_lookup(const char* str, uint8_t length){
+	if(length == 2 && !strncasecmp_P(str, PSTR("MM"), 2)){
+		return UNIT_MM;
+	}
+	if(length == 2 && !strncasecmp_P(str, PSTR("UM"), 2)){
+		return UNIT_UM;
+	}
+	if(length == 3 && !strncasecmp_P(str, PSTR("DEG"), 3)){
+		return UNIT_DEG;
+	}
+	return UNIT_INVALID;
+}
+
+int32_t units_base_per_unit(uint8_t unit){
+	return (unit == UNIT_UM) ? 1 : 1000;
+}
+
+uint8_t units_set_scale(int32_t counts, int32_t base, uint8_t axis){
+	if(axis != UNIT_STEP){
+		if(counts <= 0 || counts > UNITS_COUNTS_MAX || base <= 0 || base > UNITS_BASE_MAX){
+			return 0;
+		}
+		if(axis == UNIT_UM){
+			axis = UNIT_MM;
+		}
+	}
+	else{
+		counts = 0;
+		base = 0;
+	}
+	
+	scale_counts = counts;
+	scale_base = base;
+	scale_axis = axis;
+	
+	if(!units_compatible(report_unit)){
+		report_unit = UNIT_STEP;
+	}
+	return 1;
+}
+
+void units_get_scale(int32_t* counts, int32_t* base, uint8_t* axis){
+	*counts = scale_counts;
+	*base = scale_base;
+	*axis = scale_axis;
+}
+
+uint8_t units_compatible(uint8_t unit){
+	switch(unit){
+		case UNIT_STEP:
+			return 1;
+		
+		case UNIT_MM:
+		case UNIT_UM:
+			return scale_axis == UNIT_MM;
+		
+		case UNIT_DEG:
+			return scale_axis == UNIT_DEG;
+		
+		default:
+			return 0;
+	}
+}
+
+uint8_t units_set_report(uint8_t unit){
+	if(!units_compatible(unit)){
+		return 0;
+	}
+	report_unit = unit;
+	return 1;
+}
+
+uint8_t units_get_report(){
+	return report_unit;
+}
+
+/*
+ * value = base * counts / (base units * POSITION_SCALE / scale), the
+ * limits of the scale ratio keep all products below 2^63.
+ */
+uint8_t units_to_steps(int32_t base, int32_t scale, int32_t* value){
+	int64_t result;
+	
+	result = div_round((int64_t)base * scale_counts, (int64_t)scale_base * (POSITION_SCALE / scale));
+	
+	if(result > INT32_MAX || result < INT32_MIN){
+		return 0;
+	}
+	*value = (int32_t)result;
+	return 1;
+}
+
+int32_t units_from_steps(int32_t value, int32_t scale){
+	int64_t result;
+	
+	result = div_round((int64_t)value * (POSITION_SCALE / scale) * scale_base, scale_counts);
+	
+	if(result > INT32_MAX){
+		return INT32_MAX;
+	}
+	if(result < INT32_MIN){
+		return INT32_MIN;
+	}
+	return (int32_t)result;
+}
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Host stand-in for the parts of the Arduino core used by the firmware
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef MOCK_ARDUINO_H
+#define MOCK_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/interrupt.h>
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+/* return mock_millis, see mock.h */
+unsigned long millis(void);
+unsigned long micros(void);
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Host stand-in for avr/eeprom.h, EEMEM variables live in RAM
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef MOCK_AVR_EEPROM_H
+#define MOCK_AVR_EEPROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define EEMEM
+
+#define eeprom_is_ready() 1
+#define eeprom_busy_wait() do{ } while(0)
+
+static inline uint8_t eeprom_read_byte(const uint8_t* address){
+	return *address;
+}
+
+static inline void eeprom_write_byte(uint8_t* address, uint8_t value){
+	*address = value;
+}
+
+static inline void eeprom_update_byte(uint8_t* address, uint8_t value){
+	*address = value;
+}
+
+static inline void eeprom_read_block(void* destination, const void* source, size_t length){
+	memcpy(destination, source, length);
+}
+
+static inline void eeprom_write_block(const void* source, void* destination, size_t length){
+	memcpy(destination, source, length);
+}
+
+static inline void eeprom_update_block(const void* source, void* destination, size_t length){
+	memcpy(destination, source, length);
+}
+
+#endif
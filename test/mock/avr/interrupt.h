@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Host stand-in for avr/interrupt.h, an ISR is a plain function that
+ * tests call to simulate the interrupt
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef MOCK_AVR_INTERRUPT_H
+#define MOCK_AVR_INTERRUPT_H
+
+#ifdef __cplusplus
+#define ISR(vector, ...) extern "C" void vector(void); extern "C" void vector(void)
+#else
+#define ISR(vector, ...) void vector(void); void vector(void)
+#endif
+#define ISR_NOBLOCK
+
+#define sei()
+#define cli()
+
+#endif
@@ -0,0 +1,98 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Host stand-in for the ATmega328 registers
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef MOCK_AVR_IO_H
+#define MOCK_AVR_IO_H
+
+#include <stdint.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#define _BV(bit) (1u << (bit))
+#define bit_is_set(reg, bit) ((reg) & _BV(bit))
+#define bit_is_clear(reg, bit) (!((reg) & _BV(bit)))
+#define loop_until_bit_is_set(reg, bit) do{ } while(0)
+#define loop_until_bit_is_clear(reg, bit) do{ } while(0)
+
+/*
+ * The registers are plain variables, defined once by mock.h. Tests set
+ * PINx to drive inputs and read PORTx, DDRx and the timer registers.
+ */
+#define MOCK_REGISTERS(R8, R16) \
+	R8(PORTB) R8(PORTC) R8(PORTD) R8(DDRB) R8(DDRC) R8(DDRD) \
+	R8(PINB) R8(PINC) R8(PIND) \
+	R8(TCCR1A) R8(TCCR1B) R16(TCNT1) R16(OCR1A) R8(TIMSK1) \
+	R8(TCCR2A) R8(TCCR2B) R8(TCNT2) R8(OCR2A) R8(OCR2B) R8(TIFR2) R8(TIMSK2) \
+	R8(TCNT0) R8(TIFR0) \
+	R8(PCICR) R8(PCMSK0) R8(PCMSK1) R8(PCMSK2) R8(EICRA) R8(EIMSK) R8(EIFR) \
+	R8(UCSR0A) R8(UCSR0B) R8(UCSR0C) R16(UBRR0) R8(UDR0) \
+	R8(SREG) R8(MCUSR) R8(ACSR) R8(ADCSRB)
+
+#define MOCK_DECLARE8(name) extern volatile uint8_t name;
+#define MOCK_DECLARE16(name) extern volatile uint16_t name;
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+MOCK_REGISTERS(MOCK_DECLARE8, MOCK_DECLARE16)
+
+#ifdef __cplusplus
+	}
+#endif
+
+enum { PB0, PB1, PB2, PB3, PB4, PB5, PB6, PB7 };
+enum { PC0, PC1, PC2, PC3, PC4, PC5, PC6 };
+enum { PD0, PD1, PD2, PD3, PD4, PD5, PD6, PD7 };
+
+/* Timer1 and Timer2 */
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define OCIE1A 1
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define WGM21 1
+#define OCIE2A 1
+#define OCIE2B 2
+#define OCF2B 2
+#define TOV0 0
+
+/* pin change and external interrupts */
+#define PCIE0 0
+#define PCIE1 1
+#define PCIE2 2
+#define INT0 0
+#define INT1 1
+#define INTF1 1
+#define ISC10 2
+#define ISC11 3
+
+/* USART0 */
+#define U2X0 1
+#define DOR0 3
+#define FE0 4
+#define UDRE0 5
+#define TXC0 6
+#define RXC0 7
+#define UCSZ00 1
+#define UCSZ01 2
+#define TXEN0 3
+#define RXEN0 4
+#define UDRIE0 5
+#define RXCIE0 7
+
+/* analog comparator */
+#define ACIE 3
+#define ACI 4
+#define ACBG 6
+#define ACD 7
+
+#endif
@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Host stand-in for avr/wdt.h
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef MOCK_AVR_WDT_H
+#define MOCK_AVR_WDT_H
+
+#define WDTO_15MS 0
+
+#define wdt_reset()
+#define wdt_enable(timeout)
+#define wdt_disable()
+
+#endif
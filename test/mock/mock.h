@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Host test support: register and clock stand-ins, heap accounting
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef MOCK_H
+#define MOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <Arduino.h>
+
+/*
+ * Exactly one file of a test, the one with main(), defines
+ * MOCK_IMPLEMENTATION before including this header. It then holds the
+ * registers, millis(), _delay_us() and the heap wrappers.
+ *
+ * The native environment links with --wrap=malloc,--wrap=free, so all
+ * heap operations of the firmware go through mock_malloc() accounting.
+ */
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+extern unsigned long mock_millis;		// returned by millis()
+extern unsigned long mock_mallocs;		// successful malloc() calls
+extern unsigned long mock_frees;		// free() calls with a block
+extern long mock_malloc_budget;			// malloc() calls left before one fails, -1 for no limit
+extern void (*mock_delay_hook)(double us);	// called by _delay_us(), NULL for none
+
+/* interrupt vectors of the firmware */
+void TIMER1_COMPA_vect(void);
+void TIMER2_COMPA_vect(void);
+void TIMER2_COMPB_vect(void);
+void INT1_vect(void);
+void PCINT1_vect(void);
+void PCINT2_vect(void);
+void USART_RX_vect(void);
+void USART_UDRE_vect(void);
+
+#ifdef MOCK_IMPLEMENTATION
+
+#include <stdlib.h>
+
+#define MOCK_DEFINE8(name) volatile uint8_t name;
+#define MOCK_DEFINE16(name) volatile uint16_t name;
+
+MOCK_REGISTERS(MOCK_DEFINE8, MOCK_DEFINE16)
+
+unsigned long mock_millis;
+unsigned long mock_mallocs;
+unsigned long mock_frees;
+long mock_malloc_budget = -1;
+void (*mock_delay_hook)(double us);
+
+unsigned long millis(void){
+	return mock_millis;
+}
+
+unsigned long micros(void){
+	return mock_millis * 1000;
+}
+
+void mock_delay_us(double us){
+	if(mock_delay_hook != NULL) mock_delay_hook(us);
+}
+
+void* __real_malloc(size_t size);
+void __real_free(void* block);
+
+void* __wrap_malloc(size_t size){
+	if(mock_malloc_budget == 0) return NULL;
+	if(mock_malloc_budget > 0) mock_malloc_budget--;
+
+	mock_mallocs++;
+	return __real_malloc(size);
+}
+
+void __wrap_free(void* block){
+	if(block != NULL) mock_frees++;
+	__real_free(block);
+}
+
+#endif
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
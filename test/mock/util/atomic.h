@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Host stand-in for util/atomic.h, tests run single threaded
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef MOCK_UTIL_ATOMIC_H
+#define MOCK_UTIL_ATOMIC_H
+
+#define ATOMIC_BLOCK(type) for(int mock_atomic_ = 1; mock_atomic_; mock_atomic_ = 0)
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+
+#endif
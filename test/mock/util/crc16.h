@@ -0,0 +1,23 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Host stand-in for util/crc16.h, same results as the avr-libc versions
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef MOCK_UTIL_CRC16_H
+#define MOCK_UTIL_CRC16_H
+
+#include <stdint.h>
+
+/* CRC-8, polynomial x^8 + x^2 + x + 1, initial value 0 */
+static inline uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data){
+	uint8_t i;
+
+	crc ^= data;
+	for(i = 0; i < 8; i++){
+		crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+	}
+	return crc;
+}
+
+#endif
@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Host stand-in for util/delay.h, delays return at once
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#ifndef MOCK_UTIL_DELAY_H
+#define MOCK_UTIL_DELAY_H
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+/* calls mock_delay_hook if set, so a test can look at pulses on the pins */
+void mock_delay_us(double us);
+
+#ifdef __cplusplus
+	}
+#endif
+
+#define _delay_ms(ms)
+#define _delay_us(us) mock_delay_us(us)
+
+#endif
@@ -0,0 +1,180 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Host benchmark of the SCPI stack: commands per second, heap operations
+ * per command and the numeric argument parsers
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#define MOCK_IMPLEMENTATION
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unity.h>
+
+#include "mock.h"
+#include <scpiparser.h>
+#include "scpi_functions.h"
+#include "A4988.h"
+
+#define BENCHMARK_ROUNDS 20000
+
+void setup();
+
+/* typical host traffic, queries and settings of the motor */
+static const char* const messages[] = {
+  "*IDN?",
+  ":MOT:POS?",
+  ":POS?",
+  ":mot:sp?",
+  ":MOT:ACC 200",
+  ":MOT:LIM:POS 1000;NEG -1000",
+  ":MOT:SCAN:PROG?",
+  ":SYSTem:ERRor?",
+};
+
+#define MESSAGE_COUNT (sizeof(messages)/sizeof(messages[0]))
+
+/* plain decimal arguments as sent for positions, speeds and ramps */
+static const char* const arguments[] = {
+  "0",
+  "200",
+  "-1500",
+  "12.5",
+  "-0.0625",
+  " 65536.25 ",
+  "1000000",
+  "3.141593",
+};
+
+#define ARGUMENT_COUNT (sizeof(arguments)/sizeof(arguments[0]))
+
+static volatile int32_t sink;		// keeps the parse results alive
+
+
+static double seconds(){
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void execute(const char* message){
+  response_len = 0;
+  scpi_execute_message(&ctx, message, strlen(message));
+  response_len = 0;
+}
+
+void setUp(){
+}
+
+void tearDown(){
+}
+
+
+void test_commands_per_second(){
+  char report[96];
+  double start;
+  double elapsed;
+  uint32_t round;
+  uint8_t i;
+
+  start = seconds();
+  for(round = 0; round < BENCHMARK_ROUNDS; round++){
+    for(i = 0; i < MESSAGE_COUNT; i++){
+      execute(messages[i]);
+    }
+  }
+  elapsed = seconds() - start;
+
+  snprintf(report, sizeof(report), "%.0f commands/s, %.2f us per command",
+           BENCHMARK_ROUNDS * MESSAGE_COUNT / elapsed, elapsed * 1e6 / (BENCHMARK_ROUNDS * MESSAGE_COUNT));
+  TEST_MESSAGE(report);
+}
+
+/*
+ * Each token is one malloc and one free. Every message has to return
+ * all of its blocks.
+ */
+void test_heap_operations(){
+  char report[96];
+  unsigned long mallocs;
+  unsigned long frees;
+  uint8_t i;
+
+  for(i = 0; i < MESSAGE_COUNT; i++){
+    mallocs = mock_mallocs;
+    frees = mock_frees;
+    execute(messages[i]);
+
+    snprintf(report, sizeof(report), "%-28s %lu malloc, %lu free", messages[i], mock_mallocs - mallocs, mock_frees - frees);
+    TEST_MESSAGE(report);
+    TEST_ASSERT_EQUAL_INT(mock_mallocs, mock_frees);
+  }
+}
+
+/*
+ * The fixed point path has to give the same counts as the float path
+ * it replaces.
+ */
+void test_parse_fixed_matches_numeric(){
+  struct scpi_numeric numeric;
+  int32_t value;
+  uint8_t i;
+
+  for(i = 0; i < ARGUMENT_COUNT; i++){
+    numeric = scpi_parse_numeric(arguments[i], strlen(arguments[i]), 0, 0, 0);
+
+    TEST_ASSERT_TRUE_MESSAGE(scpi_parse_fixed(arguments[i], strlen(arguments[i]), POSITION_SCALE, &value), arguments[i]);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(lround((double)numeric.value * POSITION_SCALE), value, arguments[i]);
+  }
+}
+
+void test_parse_fixed_against_numeric(){
+  char report[96];
+  struct scpi_numeric numeric;
+  int32_t value;
+  double start;
+  double fixed_time;
+  double numeric_time;
+  uint32_t round;
+  uint8_t i;
+
+  start = seconds();
+  for(round = 0; round < BENCHMARK_ROUNDS; round++){
+    for(i = 0; i < ARGUMENT_COUNT; i++){
+      scpi_parse_fixed(arguments[i], strlen(arguments[i]), POSITION_SCALE, &value);
+      sink = value;
+    }
+  }
+  fixed_time = seconds() - start;
+
+  start = seconds();
+  for(round = 0; round < BENCHMARK_ROUNDS; round++){
+    for(i = 0; i < ARGUMENT_COUNT; i++){
+      numeric = scpi_parse_numeric(arguments[i], strlen(arguments[i]), 0, 0, 0);
+      sink = (int32_t)(numeric.value * POSITION_SCALE);
+    }
+  }
+  numeric_time = seconds() - start;
+
+  snprintf(report, sizeof(report), "scpi_parse_fixed %.1f ns, scpi_parse_numeric %.1f ns per argument, %.1f times faster",
+           fixed_time * 1e9 / (BENCHMARK_ROUNDS * ARGUMENT_COUNT), numeric_time * 1e9 / (BENCHMARK_ROUNDS * ARGUMENT_COUNT),
+           numeric_time / fixed_time);
+  TEST_MESSAGE(report);
+}
+
+int main(int argc, char** argv){
+  PIND = _BV(PD2) | _BV(PD4);
+  setup();
+  set_microstepping((microstep_t)DRIVER_MICROSTEPS_DEFAULT);
+  update_state();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_commands_per_second);
+  RUN_TEST(test_heap_operations);
+  RUN_TEST(test_parse_fixed_matches_numeric);
+  RUN_TEST(test_parse_fixed_against_numeric);
+  return UNITY_END();
+}
@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Host tests of the driver traits, run once per driver environment
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#define MOCK_IMPLEMENTATION
+
+#include <string.h>
+#include <unity.h>
+
+#include "mock.h"
+#include <scpiparser.h>
+#include "scpi_functions.h"
+#include "A4988.h"
+#include "pvt.h"
+
+void setup();
+
+/*
+ * Microstep modes and MS pin levels from the data sheets, bit 0 for
+ * MS1 (MODE0), bit 1 for MS2 (MODE1) and bit 2 for MS3 (MODE2). These
+ * are written out again instead of taken from the driver header, so a
+ * wrong header fails here.
+ */
+struct mode{
+  microstep_t stepping;
+  uint8_t levels;
+};
+
+static const struct mode modes[] = {
+#if defined(DRIVER_DRV8825)
+  {FULL, 0}, {HALF, 1}, {QUARTER, 2}, {EIGHTH, 3}, {SIXTEENTH, 4}, {THIRTYSECOND, 5},
+#elif defined(DRIVER_TMC2208)
+  {HALF, 1}, {QUARTER, 2}, {EIGHTH, 0}, {SIXTEENTH, 3},
+#elif defined(DRIVER_TMC2209)
+  {EIGHTH, 0}, {SIXTEENTH, 3}, {THIRTYSECOND, 1}, {SIXTYFOURTH, 2},
+#else
+  {FULL, 0}, {HALF, 1}, {QUARTER, 2}, {EIGHTH, 3}, {SIXTEENTH, 7},
+#endif
+};
+
+#define MODE_COUNT (sizeof(modes)/sizeof(modes[0]))
+
+static const microstep_t all_modes[] = {FULL, HALF, QUARTER, EIGHTH, SIXTEENTH, THIRTYSECOND, SIXTYFOURTH};
+
+
+static uint8_t ms_levels(){
+  return ((PORTD & _BV(PD6)) ? 1 : 0) | ((PORTD & _BV(PD7)) ? 2 : 0) | ((PORTB & _BV(PB0)) ? 4 : 0);
+}
+
+static void execute(const char* message){
+  response_len = 0;
+  scpi_execute_message(&ctx, message, strlen(message));
+  response_len = 0;
+}
+
+static uint8_t supported(microstep_t stepping){
+  uint8_t i;
+
+  for(i = 0; i < MODE_COUNT; i++){
+    if(modes[i].stepping == stepping) return 1;
+  }
+  return 0;
+}
+
+/*
+ * Step rate of the current Timer1 setting, 0 while the timer is off.
+ */
+static uint32_t step_rate(){
+  static const uint16_t prescalers[] = {0, 1, 8, 64, 256, 1024};
+  uint8_t clock_select = TCCR1B & 7;
+
+  if(clock_select == 0 || clock_select > 5) return 0;
+  return F_CPU / prescalers[clock_select] / (OCR1A + 1UL);
+}
+
+void setUp(){
+  set_microstepping((microstep_t)DRIVER_MICROSTEPS_DEFAULT);
+  set_position_cnt(0);
+}
+
+void tearDown(){
+}
+
+
+void test_microstep_levels(){
+  uint8_t i;
+
+  for(i = 0; i < MODE_COUNT; i++){
+    set_microstepping(modes[i].stepping);
+    TEST_ASSERT_EQUAL_INT(modes[i].levels, ms_levels());
+    TEST_ASSERT_EQUAL_INT(modes[i].stepping, MICROSTEPS);
+  }
+}
+
+void test_unsupported_modes_are_ignored(){
+  uint8_t levels;
+  uint8_t i;
+
+  for(i = 0; i < sizeof(all_modes)/sizeof(all_modes[0]); i++){
+    if(supported(all_modes[i])) continue;
+
+    levels = ms_levels();
+    set_microstepping(all_modes[i]);
+    TEST_ASSERT_EQUAL_INT(levels, ms_levels());
+    TEST_ASSERT_EQUAL_INT(DRIVER_MICROSTEPS_DEFAULT, MICROSTEPS);
+  }
+}
+
+void test_position_scale(){
+  uint8_t finest = 0;
+  uint8_t i;
+
+  for(i = 0; i < MODE_COUNT; i++){
+    if(modes[i].stepping > finest) finest = modes[i].stepping;
+  }
+  TEST_ASSERT_EQUAL_INT(DRIVER_MICROSTEPS_MAX, finest);
+  TEST_ASSERT_EQUAL_INT(DRIVER_MICROSTEPS_MAX, POSITION_SCALE);
+  TEST_ASSERT_TRUE(supported((microstep_t)DRIVER_MICROSTEPS_DEFAULT));
+}
+
+/*
+ * A full step is POSITION_SCALE counts in every mode, made of as many
+ * steps as the mode divides it into.
+ */
+void test_full_step_in_every_mode(){
+  uint16_t steps;
+  uint8_t i;
+
+  for(i = 0; i < MODE_COUNT; i++){
+    set_microstepping(modes[i].stepping);
+    set_position_cnt(0);
+
+    TEST_ASSERT_EQUAL_INT(MOTION_OK, move_relative_cnt(POSITION_SCALE));
+    for(steps = 0; STATE == MOVING && steps < 1000; steps++){
+      TIMER1_COMPA_vect();
+    }
+    TEST_ASSERT_EQUAL_INT(modes[i].stepping, steps);
+    TEST_ASSERT_EQUAL_INT(POSITION_SCALE, get_position_cnt());
+  }
+}
+
+/*
+ * The ramp at the highest speed and acceleration stays within the step
+ * rate of the driver.
+ */
+void test_ramp_step_rate(){
+  uint32_t fastest = 0;
+  uint32_t steps;
+
+  set_microstepping(modes[MODE_COUNT-1].stepping);
+  execute(":MOT:SP MAX;ACC MAX;DEC MAX");
+
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, move_relative_cnt(100L * POSITION_SCALE));
+  for(steps = 0; STATE == MOVING && steps < 100000; steps++){
+    if(step_rate() > fastest) fastest = step_rate();
+    TIMER1_COMPA_vect();
+  }
+  TEST_ASSERT_TRUE(fastest > 0);
+  TEST_ASSERT_LESS_OR_EQUAL(DRIVER_STEP_RATE_MAX, fastest);
+
+  execute(":MOT:SP DEF;ACC DEF;DEC DEF");
+}
+
+/*
+ * A trajectory point far beyond the reach of the motor makes the
+ * follower step as fast as it may.
+ */
+void test_trajectory_step_rate(){
+  uint32_t fastest = 0;
+  uint16_t tick;
+  uint16_t ms;
+
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_add(1000000L, 0, 100));
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_start());
+
+  for(ms = 0; ms < 150 && pvt_status() == PVT_RUNNING; ms++){
+    mock_millis++;
+    pvt_service();
+    if(TIMSK2 & _BV(OCIE2B)) TIMER2_COMPB_vect();
+
+    for(tick = 0; tick < F_CPU / 64 / 1000; tick++){
+      if((TCCR1B & 7) != 3) break;
+      if(step_rate() > fastest) fastest = step_rate();
+      if(TCNT1 >= OCR1A){
+        TCNT1 = 0;
+        TIMER1_COMPA_vect();
+      }
+      else{
+        TCNT1++;
+      }
+    }
+  }
+  pvt_clear();
+  follow_stop();
+
+  TEST_ASSERT_TRUE(fastest > 0);
+  TEST_ASSERT_LESS_OR_EQUAL(DRIVER_STEP_RATE_MAX, fastest);
+}
+
+int main(int argc, char** argv){
+  PIND = _BV(PD2) | _BV(PD4);
+  setup();
+  update_state();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_microstep_levels);
+  RUN_TEST(test_unsupported_modes_are_ignored);
+  RUN_TEST(test_position_scale);
+  RUN_TEST(test_full_step_in_every_mode);
+  RUN_TEST(test_ramp_step_rate);
+  RUN_TEST(test_trajectory_step_rate);
+  return UNITY_END();
+}
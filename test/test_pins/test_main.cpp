@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Host tests of the pins: limit switch inputs, LED and the driver outputs
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#define MOCK_IMPLEMENTATION
+
+#include <string.h>
+#include <unity.h>
+
+#include "mock.h"
+#include <scpiparser.h>
+#include "scpi_functions.h"
+#include "A4988.h"
+
+#define SW_NEG _BV(PD2)
+#define SW_POS _BV(PD4)
+
+extern volatile uint8_t UPDATE_FLAG;
+
+void setup();
+
+static char response[BUF_LEN + 1];
+
+
+static const char* query(const char* message){
+  response_len = 0;
+  scpi_execute_message(&ctx, message, strlen(message));
+
+  memcpy(response, response_buffer, response_len);
+  response[response_len] = 0;
+  if(response_len > 0 && response[response_len-1] == '\n'){
+    response[response_len-1] = 0;
+  }
+  response_len = 0;
+  return response;
+}
+
+/*
+ * Set the switch inputs like the hardware, pressed switches pull their
+ * input low, and handle the pin change like the main loop.
+ */
+static void switches(uint8_t pressed){
+  PIND = (PIND | SW_NEG | SW_POS) & ~pressed;
+
+  UPDATE_FLAG = 0;
+  PCINT2_vect();
+  TEST_ASSERT_EQUAL_INT(1, UPDATE_FLAG);
+
+  update_state();
+  UPDATE_FLAG = 0;
+}
+
+static uint8_t led(){
+  return (PORTB & _BV(PB5)) ? 1 : 0;
+}
+
+static uint16_t steps_until_stopped(){
+  uint16_t steps;
+
+  for(steps = 0; STATE == MOVING && steps < 10000; steps++){
+    TIMER1_COMPA_vect();
+  }
+  return steps;
+}
+
+void setUp(){
+  switches(0);
+  set_position_cnt(0);
+}
+
+void tearDown(){
+}
+
+
+void test_pin_directions(){
+  TEST_ASSERT_EQUAL_HEX8(_BV(PB0) | _BV(PB1) | _BV(PB2) | _BV(PB3) | _BV(PB4) | _BV(PB5), DDRB);
+  TEST_ASSERT_EQUAL_HEX8(_BV(PD5) | _BV(PD6) | _BV(PD7), DDRD);
+
+  // switches tri state, the list trigger pulled up
+  TEST_ASSERT_EQUAL_HEX8(0, PORTD & (SW_NEG | SW_POS));
+  TEST_ASSERT_EQUAL_HEX8(_BV(PD3), PORTD & _BV(PD3));
+
+  // both switches on the port D pin change interrupt
+  TEST_ASSERT_EQUAL_HEX8(SW_NEG | SW_POS, PCMSK2);
+  TEST_ASSERT_TRUE(PCICR & _BV(PCIE2));
+}
+
+void test_released(){
+  TEST_ASSERT_EQUAL_INT(FREE, get_switch_state());
+  TEST_ASSERT_EQUAL_INT(0, led());
+  TEST_ASSERT_EQUAL_STRING("STOPPED", query(":MOT:STATE?"));
+}
+
+void test_positive_switch(){
+  switches(SW_POS);
+
+  TEST_ASSERT_EQUAL_INT(LIMIT_POS, get_switch_state());
+  TEST_ASSERT_EQUAL_INT(1, led());
+  TEST_ASSERT_EQUAL_STRING("LIM+", query(":MOT:STATE?"));
+
+  // only moves out of the switch
+  TEST_ASSERT_EQUAL_INT(MOTION_LIMIT_SWITCH, move_relative_cnt(POSITION_SCALE));
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, move_relative_cnt(-POSITION_SCALE));
+  steps_until_stopped();
+  TEST_ASSERT_EQUAL_INT(-POSITION_SCALE, get_position_cnt());
+
+  switches(0);
+  TEST_ASSERT_EQUAL_INT(FREE, get_switch_state());
+  TEST_ASSERT_EQUAL_INT(0, led());
+}
+
+void test_negative_switch(){
+  switches(SW_NEG);
+
+  TEST_ASSERT_EQUAL_INT(LIMIT_NEG, get_switch_state());
+  TEST_ASSERT_EQUAL_INT(1, led());
+  TEST_ASSERT_EQUAL_STRING("LIM-", query(":MOT:STATE?"));
+
+  TEST_ASSERT_EQUAL_INT(MOTION_LIMIT_SWITCH, move_relative_cnt(-POSITION_SCALE));
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, move_relative_cnt(POSITION_SCALE));
+  steps_until_stopped();
+  TEST_ASSERT_EQUAL_INT(POSITION_SCALE, get_position_cnt());
+
+  switches(0);
+  TEST_ASSERT_EQUAL_INT(FREE, get_switch_state());
+}
+
+void test_both_switches(){
+  switches(SW_NEG | SW_POS);
+
+  TEST_ASSERT_EQUAL_INT(FAULT, get_switch_state());
+  TEST_ASSERT_EQUAL_INT(1, led());
+  TEST_ASSERT_EQUAL_STRING("FAULT", query(":MOT:STATE?"));
+  TEST_ASSERT_EQUAL_INT(MOTION_LIMIT_SWITCH, move_relative_cnt(POSITION_SCALE));
+  TEST_ASSERT_EQUAL_INT(MOTION_LIMIT_SWITCH, move_relative_cnt(-POSITION_SCALE));
+}
+
+/*
+ * A switch halts a running move at once.
+ */
+void test_switch_halts_move(){
+  uint16_t i;
+
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, move_relative_cnt(100L * POSITION_SCALE));
+  for(i = 0; i < 10; i++){
+    TIMER1_COMPA_vect();
+  }
+  TEST_ASSERT_EQUAL_INT(MOVING, STATE);
+
+  switches(SW_POS);
+  TEST_ASSERT_EQUAL_INT(STOPPED, STATE);
+  TEST_ASSERT_EQUAL_INT(0, TCCR1B & 7);
+  TEST_ASSERT_EQUAL_INT(0, steps_until_stopped());
+  TEST_ASSERT_TRUE(get_position_cnt() < 100L * POSITION_SCALE);
+}
+
+/*
+ * DIR is high for positive moves, each step ends with STEP low again.
+ */
+void test_step_and_direction(){
+  int32_t position;
+
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, move_relative_cnt(POSITION_SCALE));
+  TEST_ASSERT_TRUE(PORTB & _BV(PB4));
+  while(STATE == MOVING){
+    position = get_position_cnt();
+    TIMER1_COMPA_vect();
+    TEST_ASSERT_EQUAL_INT(position + POSITION_SCALE / MICROSTEPS, get_position_cnt());
+    TEST_ASSERT_FALSE(PORTB & _BV(PB3));
+  }
+
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, move_relative_cnt(-POSITION_SCALE));
+  TEST_ASSERT_FALSE(PORTB & _BV(PB4));
+  while(STATE == MOVING){
+    position = get_position_cnt();
+    TIMER1_COMPA_vect();
+    TEST_ASSERT_EQUAL_INT(position - POSITION_SCALE / MICROSTEPS, get_position_cnt());
+    TEST_ASSERT_FALSE(PORTB & _BV(PB3));
+  }
+  TEST_ASSERT_EQUAL_INT(0, get_position_cnt());
+}
+
+int main(int argc, char** argv){
+  PIND = SW_NEG | SW_POS;
+  setup();
+  set_microstepping((microstep_t)DRIVER_MICROSTEPS_DEFAULT);
+  update_state();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_pin_directions);
+  RUN_TEST(test_released);
+  RUN_TEST(test_positive_switch);
+  RUN_TEST(test_negative_switch);
+  RUN_TEST(test_both_switches);
+  RUN_TEST(test_switch_halts_move);
+  RUN_TEST(test_step_and_direction);
+  return UNITY_END();
+}
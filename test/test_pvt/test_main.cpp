@@ -0,0 +1,300 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Host tests of the PVT trajectories, with Timer1 and the Timer2 tick
+ * simulated
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#define MOCK_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "mock.h"
+#include <scpiparser.h>
+#include "scpi_functions.h"
+#include "A4988.h"
+#include "pvt.h"
+
+#define S POSITION_SCALE		// counts per full step
+
+void setup();
+
+static char response[BUF_LEN + 1];
+
+static int32_t highest;		// highest position of the last run
+static int32_t lowest;
+
+
+static const char* query(const char* message){
+  response_len = 0;
+  scpi_execute_message(&ctx, message, strlen(message));
+
+  memcpy(response, response_buffer, response_len);
+  response[response_len] = 0;
+  if(response_len > 0 && response[response_len-1] == '\n'){
+    response[response_len-1] = 0;
+  }
+  response_len = 0;
+  return response;
+}
+
+static int next_error(){
+  return atoi(query("SYST:ERR?"));
+}
+
+/*
+ * Simulate ms milliseconds: the main loop, the 1 kHz tick on Timer2 and
+ * Timer1 counting at F_CPU / 64 in between.
+ */
+static void run(uint16_t ms){
+  uint16_t tick;
+
+  while(ms-- > 0){
+    mock_millis++;
+    pvt_service();
+    if(TIMSK2 & _BV(OCIE2B)) TIMER2_COMPB_vect();
+
+    for(tick = 0; tick < F_CPU / 64 / 1000; tick++){
+      if((TCCR1B & 7) != 3) break;
+      if(TCNT1 >= OCR1A){
+        TCNT1 = 0;
+        TIMER1_COMPA_vect();
+        if(get_position_cnt() > highest) highest = get_position_cnt();
+        if(get_position_cnt() < lowest) lowest = get_position_cnt();
+      }
+      else{
+        TCNT1++;
+      }
+    }
+  }
+}
+
+void setUp(){
+  pvt_clear();
+  pvt_clear();		// IDLE after an aborted run
+  set_position_cnt(0);
+  query("*CLS;:MOT:LIM:POS DEF;:MOT:LIM:NEG DEF");
+  highest = 0;
+  lowest = 0;
+}
+
+void tearDown(){
+}
+
+
+void test_end_to_end(){
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_add(10L * S, 40L * S, 200));
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_add(30L * S, 40L * S, 500));
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_add(40L * S, 0, 400));
+  TEST_ASSERT_EQUAL_INT(PVT_POINTS - 3, pvt_free());
+
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_start());
+  TEST_ASSERT_EQUAL_INT(PVT_RUNNING, pvt_status());
+  TEST_ASSERT_EQUAL_INT(MOVING, STATE);
+  TEST_ASSERT_EQUAL_INT(MOTION_BUSY, pvt_start());
+
+  run(1200);
+  TEST_ASSERT_EQUAL_INT(PVT_IDLE, pvt_status());
+  TEST_ASSERT_EQUAL_INT(STOPPED, STATE);
+  TEST_ASSERT_EQUAL_INT(40L * S, get_position_cnt());
+  TEST_ASSERT_EQUAL_INT(0, TCCR1B & 7);
+  TEST_ASSERT_FALSE(TIMSK2 & _BV(OCIE2B));
+  TEST_ASSERT_EQUAL_INT(PVT_POINTS, pvt_free());
+
+  // the position follows the curve without turning back
+  TEST_ASSERT_EQUAL_INT(40L * S, highest);
+  TEST_ASSERT_EQUAL_INT(0, lowest);
+}
+
+void test_points_refused(){
+  TEST_ASSERT_EQUAL_INT(MOTION_INVALID, pvt_start());
+  TEST_ASSERT_EQUAL_INT(MOTION_INVALID, pvt_add(S, 0, 0));
+  TEST_ASSERT_EQUAL_INT(MOTION_INVALID, pvt_add(S, 0, PVT_TIME_MAX + 1));
+
+  query(":MOT:LIM:POS 50;NEG -50");
+  query(":MOT:PVT 51,0,100");
+  TEST_ASSERT_EQUAL_INT(-302, next_error());
+  query(":MOT:PVT -51,0,100");
+  TEST_ASSERT_EQUAL_INT(-301, next_error());
+  query(":MOT:PVT 10,0");
+  TEST_ASSERT_EQUAL_INT(-109, next_error());
+  query(":MOT:PVT 10,0,0");
+  TEST_ASSERT_EQUAL_INT(-222, next_error());
+  TEST_ASSERT_EQUAL_INT(PVT_POINTS, pvt_free());
+}
+
+/*
+ * A start refused while the motor moves keeps all points, the next
+ * start runs the whole trajectory.
+ */
+void test_start_refused(){
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_add(10L * S, 0, 200));
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_add(20L * S, 0, 200));
+
+  query(":MOT:MOV:REL 5");
+  query(":MOT:PVT:STAR");
+  TEST_ASSERT_EQUAL_INT(-300, next_error());
+  TEST_ASSERT_EQUAL_INT(PVT_POINTS - 2, pvt_free());
+  TEST_ASSERT_EQUAL_INT(PVT_IDLE, pvt_status());
+
+  while(STATE == MOVING){
+    TIMER1_COMPA_vect();
+  }
+  TEST_ASSERT_EQUAL_INT(5L * S, get_position_cnt());
+
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_start());
+  run(150);
+  TEST_ASSERT_TRUE(get_position_cnt() > 5L * S && get_position_cnt() < 10L * S);
+  run(400);
+  TEST_ASSERT_EQUAL_INT(PVT_IDLE, pvt_status());
+  TEST_ASSERT_EQUAL_INT(20L * S, get_position_cnt());
+}
+
+void test_queue_full(){
+  uint8_t i;
+
+  for(i = 0; i < PVT_POINTS; i++){
+    TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_add(i * S, 0, 100));
+  }
+  TEST_ASSERT_EQUAL_INT(0, pvt_free());
+  TEST_ASSERT_EQUAL_INT(MOTION_BUFFER_FULL, pvt_add(S, 0, 100));
+
+  query(":MOT:PVT 1,0,100");
+  TEST_ASSERT_EQUAL_INT(-303, next_error());
+}
+
+/*
+ * The queue running empty at a point with velocity != 0 stops the
+ * motor and reports the underrun.
+ */
+void test_underrun(){
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_add(10L * S, 20L * S, 500));
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_start());
+
+  run(600);
+  TEST_ASSERT_EQUAL_INT(PVT_UNDERRUN, pvt_status());
+  TEST_ASSERT_EQUAL_STRING("UNDERRUN", query(":MOT:PVT:STATE?"));
+  TEST_ASSERT_EQUAL_INT(STOPPED, STATE);
+  TEST_ASSERT_EQUAL_INT(10L * S, get_position_cnt());
+
+  // a point added too late is not run
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_add(20L * S, 0, 500));
+  run(600);
+  TEST_ASSERT_EQUAL_INT(10L * S, get_position_cnt());
+}
+
+/*
+ * A point queued while the last steps to a stop are made continues the
+ * trajectory.
+ */
+void test_late_point(){
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_add(10L * S, 0, 100));
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_start());
+
+  run(50);
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_add(-10L * S, 0, 300));
+  run(500);
+  TEST_ASSERT_EQUAL_INT(PVT_IDLE, pvt_status());
+  TEST_ASSERT_EQUAL_INT(-10L * S, get_position_cnt());
+}
+
+void test_clear_aborts(){
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_add(100L * S, 0, 1000));
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_add(0, 0, 1000));
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_start());
+
+  run(300);
+  query(":MOT:PVT:CLE");
+  TEST_ASSERT_EQUAL_STRING("ABORTED", query(":MOT:PVT:STATE?"));
+  TEST_ASSERT_EQUAL_INT(STOPPED, STATE);
+  TEST_ASSERT_EQUAL_INT(PVT_POINTS, pvt_free());
+  TEST_ASSERT_TRUE(get_position_cnt() > 0 && get_position_cnt() < 100L * S);
+
+  highest = get_position_cnt();
+  run(100);
+  TEST_ASSERT_EQUAL_INT(highest, get_position_cnt());
+}
+
+void test_switch_aborts(){
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_add(100L * S, 0, 1000));
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_add(0, 0, 1000));
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_start());
+
+  run(300);
+  PIND &= ~_BV(PD4);
+  update_state();
+  run(10);
+  TEST_ASSERT_EQUAL_INT(PVT_ABORTED, pvt_status());
+  TEST_ASSERT_EQUAL_INT(STOPPED, STATE);
+  TEST_ASSERT_EQUAL_INT(PVT_POINTS, pvt_free());
+
+  PIND |= _BV(PD4);
+  update_state();
+}
+
+/*
+ * :MOT:STOP brakes from the velocity of the trajectory with the
+ * deceleration of the ramp, the rest is dropped. At 150 steps/s and
+ * 400 steps/s^2 the motor stops after about 28 steps.
+ */
+void test_stop_brakes(){
+  int32_t position;
+
+  query(":MOT:DEC MAX");
+  TEST_ASSERT_EQUAL_INT(0, next_error());
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_add(200L * S, 0, 2000));
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_start());
+
+  run(1000);
+  position = get_position_cnt();
+  query(":MOT:STOP");
+  run(1);
+  TEST_ASSERT_EQUAL_INT(MOVING, STATE);
+
+  run(2000);
+  TEST_ASSERT_EQUAL_INT(PVT_ABORTED, pvt_status());
+  TEST_ASSERT_EQUAL_INT(STOPPED, STATE);
+  TEST_ASSERT_TRUE(get_position_cnt() > position + 15L * S);
+  TEST_ASSERT_TRUE(get_position_cnt() < position + 45L * S);
+
+  query(":MOT:DEC DEF");
+}
+
+/*
+ * A curve overshooting the softlimit between two points is held at the
+ * softlimit and follows again once it comes back.
+ */
+void test_softlimit_hold(){
+  query(":MOT:LIM:POS 50");
+
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_add(50L * S, 400L * S, 500));
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_add(40L * S, 0, 500));
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, pvt_start());
+
+  run(1200);
+  TEST_ASSERT_EQUAL_INT(PVT_IDLE, pvt_status());
+  TEST_ASSERT_EQUAL_INT(50L * S, highest);
+  TEST_ASSERT_EQUAL_INT(40L * S, get_position_cnt());
+}
+
+int main(int argc, char** argv){
+  PIND = _BV(PD2) | _BV(PD4);
+  setup();
+  set_microstepping((microstep_t)DRIVER_MICROSTEPS_DEFAULT);
+  update_state();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_end_to_end);
+  RUN_TEST(test_points_refused);
+  RUN_TEST(test_start_refused);
+  RUN_TEST(test_queue_full);
+  RUN_TEST(test_underrun);
+  RUN_TEST(test_late_point);
+  RUN_TEST(test_clear_aborts);
+  RUN_TEST(test_switch_aborts);
+  RUN_TEST(test_stop_brakes);
+  RUN_TEST(test_softlimit_hold);
+  return UNITY_END();
+}
@@ -0,0 +1,259 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Host tests of the scans: both modes, dwell, turnaround trigger,
+ * waiting for the end of a scan and argument errors
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#define MOCK_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "mock.h"
+#include <scpiparser.h>
+#include "scpi_functions.h"
+#include "A4988.h"
+#include "scan.h"
+
+#define S POSITION_SCALE		// counts per full step
+#define PULSES_MAX 8
+
+extern volatile uint8_t MOTION_FLAG;
+
+void setup();
+
+static char response[BUF_LEN + 1];
+
+/* trigger pulses seen by the delay hook */
+static int32_t pulse_position[PULSES_MAX];
+static uint8_t pulses;
+static double pulse_width;
+
+
+static const char* take_response(){
+  memcpy(response, response_buffer, response_len);
+  response[response_len] = 0;
+  if(response_len > 0 && response[response_len-1] == '\n'){
+    response[response_len-1] = 0;
+  }
+  response_len = 0;
+  return response;
+}
+
+static const char* query(const char* message){
+  response_len = 0;
+  scpi_execute_message(&ctx, message, strlen(message));
+  return take_response();
+}
+
+static int next_error(){
+  return atoi(query("SYST:ERR?"));
+}
+
+/*
+ * A delay with the trigger output high is a trigger pulse.
+ */
+static void delay_hook(double us){
+  if(!(PORTC & _BV(PC0))) return;
+
+  TEST_ASSERT_TRUE(DDRC & _BV(PC0));
+  if(pulses < PULSES_MAX) pulse_position[pulses] = get_position_cnt();
+  pulses++;
+  pulse_width = us;
+}
+
+/*
+ * Run the step interrupt and the main loop, one millisecond per pass,
+ * until the scan has ended and a suspended message has resumed.
+ */
+static void settle(){
+  uint16_t i;
+
+  for(i = 0; i < 10000; i++){
+    while(STATE == MOVING){
+      TIMER1_COMPA_vect();
+    }
+    mock_millis++;
+    if(MOTION_FLAG == 1){
+      MOTION_FLAG = 0;
+      scpi_motion_event();
+    }
+    if(scpi_is_suspended(&ctx) && !scpi_operation_pending()){
+      scpi_resume_message(&ctx);
+    }
+    scan_service();
+    if(STATE != MOVING && !scan_running() && !scpi_is_suspended(&ctx)) break;
+  }
+}
+
+void setUp(){
+  settle();
+  response_len = 0;
+  set_position_cnt(0);
+  query("*CLS;:MOT:LIM:POS DEF;:MOT:LIM:NEG DEF;:MOT:SCAN:MODE OSC;TRIG ON");
+  pulses = 0;
+  pulse_width = 0;
+}
+
+void tearDown(){
+}
+
+
+/*
+ * Oscillation: every leg is a pass, the trigger fires at each end.
+ */
+void test_oscillate(){
+  query(":MOT:SCAN 5,10,3");
+  TEST_ASSERT_EQUAL_INT(0, next_error());
+  TEST_ASSERT_EQUAL_STRING("0,3,1", query(":MOT:SCAN:PROG?"));
+
+  settle();
+  TEST_ASSERT_EQUAL_STRING("3,3,0", query(":MOT:SCAN:PROG?"));
+  TEST_ASSERT_EQUAL_INT(10L * S, get_position_cnt());
+
+  TEST_ASSERT_EQUAL_INT(3, pulses);
+  TEST_ASSERT_EQUAL_INT(10L * S, pulse_position[0]);
+  TEST_ASSERT_EQUAL_INT(5L * S, pulse_position[1]);
+  TEST_ASSERT_EQUAL_INT(10L * S, pulse_position[2]);
+  TEST_ASSERT_EQUAL_INT(SCAN_TRIGGER_US, (int)pulse_width);
+  TEST_ASSERT_FALSE(PORTC & _BV(PC0));
+}
+
+/*
+ * Raster: every pass runs from start to stop, the return is no pass.
+ */
+void test_raster(){
+  query(":MOT:SCAN:MODE RAST;:MOT:SCAN 5,10,3");
+  TEST_ASSERT_EQUAL_INT(0, next_error());
+
+  settle();
+  TEST_ASSERT_EQUAL_STRING("3,3,0", query(":MOT:SCAN:PROG?"));
+  TEST_ASSERT_EQUAL_INT(10L * S, get_position_cnt());
+
+  TEST_ASSERT_EQUAL_INT(3, pulses);
+  TEST_ASSERT_EQUAL_INT(10L * S, pulse_position[0]);
+  TEST_ASSERT_EQUAL_INT(10L * S, pulse_position[1]);
+  TEST_ASSERT_EQUAL_INT(10L * S, pulse_position[2]);
+}
+
+void test_trigger_off(){
+  query(":MOT:SCAN:TRIG OFF");
+  TEST_ASSERT_FALSE(DDRC & _BV(PC0));
+
+  query(":MOT:SCAN 0,5,2");
+  settle();
+  TEST_ASSERT_EQUAL_STRING("2,2,0", query(":MOT:SCAN:PROG?"));
+  TEST_ASSERT_EQUAL_INT(0, pulses);
+}
+
+/*
+ * The motor stands still for the dwell time at each turnaround.
+ */
+void test_dwell(){
+  unsigned long start;
+  uint16_t i;
+
+  query(":MOT:SCAN 0,5,2,50");
+  settle();
+  TEST_ASSERT_EQUAL_STRING("2,2,0", query(":MOT:SCAN:PROG?"));
+  TEST_ASSERT_EQUAL_INT(0, get_position_cnt());
+
+  // at the start, before the first pass
+  query(":MOT:SCAN 5,0,1,50");
+  while(STATE == MOVING){
+    TIMER1_COMPA_vect();
+  }
+  scan_service();
+  start = mock_millis;
+  for(i = 0; i < 100 && STATE != MOVING; i++){
+    mock_millis++;
+    scan_service();
+  }
+  TEST_ASSERT_EQUAL_INT(50, mock_millis - start);
+  TEST_ASSERT_EQUAL_INT(5L * S, get_position_cnt());
+  settle();
+  TEST_ASSERT_EQUAL_INT(0, get_position_cnt());
+}
+
+void test_opc_query(){
+  query(":MOT:SCAN 0,5,2;*OPC?");
+  TEST_ASSERT_TRUE(scpi_is_suspended(&ctx));
+  TEST_ASSERT_EQUAL_STRING("", response);
+
+  settle();
+  TEST_ASSERT_FALSE(scpi_is_suspended(&ctx));
+  TEST_ASSERT_EQUAL_STRING("1", take_response());
+  TEST_ASSERT_EQUAL_STRING("2,2,0", query(":MOT:SCAN:PROG?"));
+}
+
+void test_wai(){
+  query(":MOT:SCAN 0,5,3;*WAI;:MOT:POS?");
+  TEST_ASSERT_TRUE(scpi_is_suspended(&ctx));
+
+  settle();
+  TEST_ASSERT_EQUAL_STRING("5.00", take_response());
+  TEST_ASSERT_EQUAL_STRING("3,3,0", query(":MOT:SCAN:PROG?"));
+}
+
+void test_stop(){
+  query(":MOT:SCAN 0,100,4");
+  TEST_ASSERT_TRUE(scan_running());
+
+  query(":MOT:STOP");
+  TEST_ASSERT_FALSE(scan_running());
+  settle();
+  TEST_ASSERT_EQUAL_STRING("0,4,0", query(":MOT:SCAN:PROG?"));
+}
+
+void test_argument_errors(){
+  query(":MOT:SCAN 5,5,2");
+  TEST_ASSERT_EQUAL_INT(-224, next_error());
+  query(":MOT:SCAN 0,5,0");
+  TEST_ASSERT_EQUAL_INT(-222, next_error());
+  query(":MOT:SCAN 0,5,2,70000");
+  TEST_ASSERT_EQUAL_INT(-222, next_error());
+  query(":MOT:SCAN 0,5");
+  TEST_ASSERT_EQUAL_INT(-109, next_error());
+
+  query(":MOT:LIM:POS 50;NEG -50");
+  query(":MOT:SCAN 0,51,2");
+  TEST_ASSERT_EQUAL_INT(-302, next_error());
+  query(":MOT:SCAN -51,0,2");
+  TEST_ASSERT_EQUAL_INT(-301, next_error());
+
+  query(":MOT:SCAN:MODE SAW");
+  TEST_ASSERT_EQUAL_INT(-224, next_error());
+  query(":MOT:SCAN:MODE");
+  TEST_ASSERT_EQUAL_INT(-109, next_error());
+  query(":MOT:SCAN:TRIG 2");
+  TEST_ASSERT_EQUAL_INT(-224, next_error());
+
+  // the motor must stand still
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, move_relative_cnt(10L * S));
+  query(":MOT:SCAN 0,5,2");
+  TEST_ASSERT_EQUAL_INT(-300, next_error());
+
+  TEST_ASSERT_FALSE(scan_running());
+  TEST_ASSERT_EQUAL_INT(0, next_error());
+}
+
+int main(int argc, char** argv){
+  PIND = _BV(PD2) | _BV(PD4);
+  setup();
+  set_microstepping((microstep_t)DRIVER_MICROSTEPS_DEFAULT);
+  update_state();
+  mock_delay_hook = delay_hook;
+
+  UNITY_BEGIN();
+  RUN_TEST(test_oscillate);
+  RUN_TEST(test_raster);
+  RUN_TEST(test_trigger_off);
+  RUN_TEST(test_dwell);
+  RUN_TEST(test_opc_query);
+  RUN_TEST(test_wai);
+  RUN_TEST(test_stop);
+  RUN_TEST(test_argument_errors);
+  return UNITY_END();
+}
@@ -0,0 +1,633 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Host tests of the SCPI commands, one exchange per command of the tree
+ * Copyright (c) 2022, Jonas Grage <grage@physik.tu-berlin.de>
+ */
+
+#define MOCK_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "mock.h"
+#include <scpiparser.h>
+#include "scpi_functions.h"
+#include "A4988.h"
+#include "pvt.h"
+#include "scan.h"
+#include "macro.h"
+#include "sequence.h"
+#include "trace.h"
+#include "uart.h"
+
+extern volatile uint8_t MOTION_FLAG;
+
+void setup();
+
+/*
+ * A message and what it should leave behind: the response without its
+ * terminator and the first error of the queue, 0 for none.
+ */
+struct exchange{
+  const char* message;
+  const char* response;
+  int error;
+};
+
+static char response[BUF_LEN + 1];
+
+
+/*
+ * Execute a message like the main loop, return its response without
+ * the terminator.
+ */
+static const char* query(const char* message){
+  response_len = 0;
+  scpi_execute_message(&ctx, message, strlen(message));
+
+  memcpy(response, response_buffer, response_len);
+  response[response_len] = 0;
+  if(response_len > 0 && response[response_len-1] == '\n'){
+    response[response_len-1] = 0;
+  }
+  response_len = 0;
+  return response;
+}
+
+static int next_error(){
+  return atoi(query("SYST:ERR?"));
+}
+
+/*
+ * One pass of the main loop after the serial input, see loop().
+ */
+static void service(){
+  if(MOTION_FLAG == 1){
+    MOTION_FLAG = 0;
+    scpi_motion_event();
+  }
+  if(scpi_is_suspended(&ctx) && !scpi_operation_pending()){
+    scpi_resume_message(&ctx);
+  }
+  macro_service(&ctx);
+  pvt_service();
+  scan_service();
+  sequence_service();
+}
+
+/*
+ * Run the step interrupt and the main loop until the motor, scans and
+ * macros have finished.
+ */
+static void settle(){
+  uint16_t i;
+
+  for(i = 0; i < 1000; i++){
+    while(STATE == MOVING){
+      TIMER1_COMPA_vect();
+    }
+    service();
+    if(STATE != MOVING && !scan_running() && !macro_running() && !scpi_is_suspended(&ctx)) break;
+  }
+}
+
+/*
+ * Simulate ms milliseconds of a trajectory: the 1 kHz tick on Timer2
+ * and Timer1 counting at F_CPU / 64.
+ */
+static void run_trajectory(uint16_t ms){
+  uint16_t tick;
+
+  while(ms-- > 0){
+    mock_millis++;
+    pvt_service();
+    if(TIMSK2 & _BV(OCIE2B)) TIMER2_COMPB_vect();
+
+    for(tick = 0; tick < F_CPU / 64 / 1000; tick++){
+      if((TCCR1B & 7) != 3) break;
+      if(TCNT1 >= OCR1A){
+        TCNT1 = 0;
+        TIMER1_COMPA_vect();
+      }
+      else{
+        TCNT1++;
+      }
+    }
+  }
+  service();
+}
+
+/*
+ * Collect what the transmit interrupt sends, up to length - 1 bytes.
+ * Returns the number of bytes.
+ */
+static size_t transmitted(char* buffer, size_t length){
+  size_t count = 0;
+
+  while((UCSR0B & _BV(UDRIE0)) && count < length - 1){
+    USART_UDRE_vect();
+    if(UCSR0B & _BV(UDRIE0)) buffer[count++] = UDR0;
+  }
+  buffer[count] = 0;
+  return count;
+}
+
+static void check(const struct exchange* exchanges, size_t count){
+  size_t i;
+
+  for(i = 0; i < count; i++){
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(exchanges[i].response, query(exchanges[i].message), exchanges[i].message);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(exchanges[i].error, next_error(), exchanges[i].message);
+  }
+}
+
+void setUp(){
+  settle();
+  query("*CLS");
+  query(":MOT:POS 0;:MOT:LIM:POS DEF;:MOT:LIM:NEG DEF");
+  mock_malloc_budget = -1;
+}
+
+void tearDown(){
+}
+
+
+void test_common_commands(){
+  static const struct exchange exchanges[] = {
+    {"*IDN?", "BLiX Stepper Motor Controller rev. 1.0", 0},
+    {"*ESR?", "0", 0},
+    {"*OPC", "", 0},
+    {"*ESR?", "1", 0},
+    {"*ESR?", "0", 0},
+    {"*OPC?", "1", 0},
+    {"*WAI", "", 0},
+    {"*SAV 3", "", 0},
+    {"*RCL 3", "", 0},
+    {"*RCL 2", "", -314},
+    {"*SAV 9", "", -222},
+  };
+
+  check(exchanges, sizeof(exchanges)/sizeof(exchanges[0]));
+}
+
+void test_wait_for_motion(){
+  query(":MOT:MOV:ABS 10;*OPC?");
+  TEST_ASSERT_TRUE(scpi_is_suspended(&ctx));
+
+  settle();
+  TEST_ASSERT_FALSE(scpi_is_suspended(&ctx));
+  TEST_ASSERT_EQUAL_STRING("10.00", query(":MOT:POS?"));
+}
+
+void test_error_queue(){
+  static const struct exchange exchanges[] = {
+    {"SYST:ERR:COUN?", "0", 0},
+    {"SYST:ERR:NEXT?", "0,\"No error\"", 0},
+    {"FOO", "", -113},
+    {"SYST:ERR?", "0,\"No error\"", 0},
+  };
+  uint8_t i;
+
+  check(exchanges, sizeof(exchanges)/sizeof(exchanges[0]));
+
+  query("FOO;BAR");
+  TEST_ASSERT_EQUAL_STRING("2", query("SYST:ERR:COUN?"));
+  TEST_ASSERT_EQUAL_STRING("-113,\"Undefined header\"", query("SYST:ERR?"));
+  query("*CLS");
+  TEST_ASSERT_EQUAL_STRING("0", query("SYST:ERR:COUN?"));
+
+  // the last slot reports the overflow
+  for(i = 0; i < SCPI_ERROR_QUEUE_LEN + 2; i++){
+    query("FOO");
+  }
+  for(i = 0; i < SCPI_ERROR_QUEUE_LEN - 1; i++){
+    TEST_ASSERT_EQUAL_INT(-113, next_error());
+  }
+  TEST_ASSERT_EQUAL_INT(-350, next_error());
+  TEST_ASSERT_EQUAL_INT(0, next_error());
+}
+
+void test_communication(){
+  static const struct exchange exchanges[] = {
+    {"SYST:COMM:TXST?", "0,0", 0},
+    {"SYST:COMM:BAUD?", "9600", 0},
+    {"SYST:COMM:BAUD 1234", "", -222},
+    {"SYST:COMM:BAUD 10000", "", -224},
+    {"SYST:COMM:BAUD", "", -109},
+  };
+  char sent[16];
+
+  check(exchanges, sizeof(exchanges)/sizeof(exchanges[0]));
+
+  // the new rate is set once the transmit buffer is empty
+  query("SYST:COMM:BAUD 250000");
+  transmitted(sent, sizeof(sent));
+  uart_service();
+  TEST_ASSERT_EQUAL_STRING("250000", query("SYST:COMM:BAUD?"));
+
+  // and dropped again without a command at the new rate
+  mock_millis += 6000;
+  uart_service();
+  TEST_ASSERT_EQUAL_STRING("9600", query("SYST:COMM:BAUD?"));
+}
+
+void test_events(){
+  static const struct exchange exchanges[] = {
+    {"SYST:EVEN?", "0", 0},
+    {"SYST:EVEN ON", "", 0},
+    {"SYST:EVEN?", "1", 0},
+    {"SYST:EVEN OFF", "", 0},
+    {"SYST:EVEN?", "0", 0},
+    {"SYST:EVEN MAYBE", "", -224},
+  };
+
+  check(exchanges, sizeof(exchanges)/sizeof(exchanges[0]));
+}
+
+void test_macros(){
+  static const struct exchange exchanges[] = {
+    {"SYST:MACR:CAT?", "\"\"", 0},
+    {"SYST:MACR:DEF \"up\",\"MOV:REL 5;*WAI\"", "", 0},
+    {"SYST:MACR:APP \"up\",\":MOT:MOV:REL 1\"", "", 0},
+    {"SYST:MACR:CAT?", "\"UP\"", 0},
+    {"SYST:MACR:DEF \"bad\",\"FOO 1\"", "", -113},
+    {"SYST:MACR:RUN \"none\"", "", -180},
+    {"SYST:MACR:RUN \"up\",2", "", 0},
+  };
+
+  check(exchanges, sizeof(exchanges)/sizeof(exchanges[0]));
+
+  TEST_ASSERT_TRUE(macro_running());
+  settle();
+  TEST_ASSERT_EQUAL_STRING("2,2,0", query("SYST:MACR:PROG?"));
+  TEST_ASSERT_EQUAL_STRING("12.00", query(":MOT:POS?"));
+
+  query("SYST:MACR:RUN \"up\",3");
+  service();
+  query("SYST:MACR:STOP");
+  settle();
+  TEST_ASSERT_EQUAL_STRING("0,3,0", query("SYST:MACR:PROG?"));
+
+  query("SYST:MACR:DEL \"up\"");
+  TEST_ASSERT_EQUAL_STRING("\"\"", query("SYST:MACR:CAT?"));
+  TEST_ASSERT_EQUAL_INT(0, next_error());
+}
+
+void test_trace(){
+  static const struct exchange exchanges[] = {
+    {"DIAG:TRAC:DEC 1", "", 0},
+    {"DIAG:TRAC:DEC?", "1", 0},
+    {"DIAG:TRAC:COUN?", "0,0", 0},
+  };
+
+  check(exchanges, sizeof(exchanges)/sizeof(exchanges[0]));
+
+  char expected[16];
+  char block[128];
+
+  // 2 full steps in the default microstep mode
+  query(":MOT:MOV:REL 2");
+  settle();
+  snprintf(expected, sizeof(expected), "%d,%d", 2 * DRIVER_MICROSTEPS_DEFAULT, 2 * DRIVER_MICROSTEPS_DEFAULT);
+  TEST_ASSERT_EQUAL_STRING(expected, query("DIAG:TRAC:COUN?"));
+
+  // definite length block of 5 bytes per sample and the terminator
+  transmitted(block, sizeof(block));
+  query("DIAG:TRAC:DATA?");
+  snprintf(expected, sizeof(expected), "#2%d", 2 * DRIVER_MICROSTEPS_DEFAULT * TRACE_SAMPLE_SIZE);
+  TEST_ASSERT_EQUAL_INT(strlen(expected) + 2 * DRIVER_MICROSTEPS_DEFAULT * TRACE_SAMPLE_SIZE + 1, transmitted(block, sizeof(block)));
+  TEST_ASSERT_EQUAL_INT(0, strncmp(expected, block, strlen(expected)));
+  TEST_ASSERT_EQUAL_INT(0, next_error());
+}
+
+void test_limits(){
+  static const struct exchange exchanges[] = {
+    {":MOT:LIM:POS 50", "", 0},
+    {":MOT:LIM:POS?", "50.00", 0},
+    {":MOT:LIM:NEG -50", "", 0},
+    {":MOT:LIM:NEG?", "-50.00", 0},
+    {":MOT:MOV:ABS 60", "", -302},
+    {":MOT:MOV:ABS -60", "", -301},
+    {":MOT:LIM:POS", "", -109},
+  };
+
+  check(exchanges, sizeof(exchanges)/sizeof(exchanges[0]));
+}
+
+void test_moves(){
+  static const struct exchange exchanges[] = {
+    {":MOT:POS 100", "", 0},
+    {":MOT:POS?", "100.00", 0},
+    {":MOT:POS:VAL?", "1", 0},
+    {":MOT:STATE?", "STOPPED", 0},
+    {":MOT:MOV:ABS 110", "", 0},
+    {":MOT:STATE?", "MOVING", 0},
+    {":MOT:MOV:REL 1", "-300->Command error: Motor busy", -300},
+  };
+
+  check(exchanges, sizeof(exchanges)/sizeof(exchanges[0]));
+
+  settle();
+  TEST_ASSERT_EQUAL_STRING("110.00", query(":MOT:POS?"));
+
+  query(":MOT:MOV:REL -20");
+  settle();
+  TEST_ASSERT_EQUAL_STRING("90.00", query(":MOT:POS?"));
+
+  query(":MOT:HOM:POS");
+  TEST_ASSERT_EQUAL_STRING("MOVING", query(":MOT:STATE?"));
+  query(":MOT:STOP");
+  settle();
+  TEST_ASSERT_EQUAL_STRING("STOPPED", query(":MOT:STATE?"));
+
+  query(":MOT:HOM:NEG");
+  TEST_ASSERT_EQUAL_STRING("MOVING", query(":MOT:STATE?"));
+  query(":MOT:STP");
+  settle();
+  TEST_ASSERT_EQUAL_STRING("STOPPED", query(":MOT:STATE?"));
+  TEST_ASSERT_EQUAL_INT(0, next_error());
+}
+
+/*
+ * Distances up to the full int32 range of the position counter.
+ */
+void test_long_moves(){
+  int32_t distance = (int32_t)(0x100000000LL / POSITION_SCALE) + POSITION_SCALE;
+  uint16_t i;
+
+  // in the finest mode distance * MICROSTEPS would wrap to a few steps
+  set_microstepping((microstep_t)DRIVER_MICROSTEPS_MAX);
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, move_relative_cnt(distance));
+  for(i = 0; i < 1000; i++){
+    TIMER1_COMPA_vect();
+  }
+  TEST_ASSERT_EQUAL_STRING("MOVING", query(":MOT:STATE?"));
+  TEST_ASSERT_EQUAL_INT(1000, get_position_cnt());
+  query(":MOT:STOP");
+  settle();
+
+  query(":MOT:POS 0");
+  TEST_ASSERT_EQUAL_INT(MOTION_OK, move_relative_cnt(INT32_MIN));
+  TEST_ASSERT_EQUAL_STRING("MOVING", query(":MOT:STATE?"));
+  TIMER1_COMPA_vect();
+  TEST_ASSERT_EQUAL_INT(-1, get_position_cnt());
+  query(":MOT:STOP");
+  settle();
+  set_microstepping((microstep_t)DRIVER_MICROSTEPS_DEFAULT);
+
+  // up to the end of the counter
+  set_position_cnt(INT32_MAX - 10L * POSITION_SCALE);
+  query(":MOT:MOV:REL 11");
+  TEST_ASSERT_EQUAL_INT(-302, next_error());
+  query(":MOT:MOV:REL 10");
+  settle();
+  TEST_ASSERT_EQUAL_INT(INT32_MAX, get_position_cnt());
+  TEST_ASSERT_EQUAL_INT(0, next_error());
+
+  // a positive move across more than half of the counter
+  query(":MOT:POS -1;:MOT:MOV:ABS MAX");
+  TEST_ASSERT_EQUAL_INT(0, next_error());
+  TEST_ASSERT_EQUAL_STRING("MOVING", query(":MOT:STATE?"));
+  TEST_ASSERT_TRUE(PORTB & _BV(PB4));
+  query(":MOT:STOP");
+  settle();
+  TEST_ASSERT_TRUE(get_position_cnt() > -POSITION_SCALE);
+}
+
+/*
+ * Home runs end at the softlimit, without room left they do nothing.
+ */
+void test_home_runs(){
+  query(":MOT:LIM:POS 5;:MOT:LIM:NEG -5");
+  query(":MOT:HOM:POS");
+  settle();
+  TEST_ASSERT_EQUAL_STRING("5.00", query(":MOT:POS?"));
+  query(":MOT:HOM:POS");
+  TEST_ASSERT_EQUAL_STRING("STOPPED", query(":MOT:STATE?"));
+
+  query(":MOT:HOM:NEG");
+  query(":MOT:HOM:POS");
+  TEST_ASSERT_EQUAL_INT(-300, next_error());
+  settle();
+  TEST_ASSERT_EQUAL_STRING("-5.00", query(":MOT:POS?"));
+
+  // absolute moves back from beyond a softlimit have to end within
+  query(":MOT:POS 10");
+  query(":MOT:MOV:ABS 8");
+  TEST_ASSERT_EQUAL_INT(-302, next_error());
+  query(":MOT:MOV:REL -2");
+  settle();
+  TEST_ASSERT_EQUAL_STRING("8.00", query(":MOT:POS?"));
+  TEST_ASSERT_EQUAL_INT(0, next_error());
+}
+
+void test_parameters(){
+  static const struct exchange exchanges[] = {
+    {":MOT:ACC 250", "", 0},
+    {":MOT:ACC?", "250", 0},
+    {":MOT:ACC MAX", "", 0},
+    {":MOT:ACC?", "400", 0},
+    {":MOT:ACC DEF", "", 0},
+    {":MOT:ACC?", "100", 0},
+    {":MOT:DEC 150", "", 0},
+    {":MOT:DEC?", "150", 0},
+    {":MOT:DEC DEF", "", 0},
+    {":MOT:SP 500", "", 0},
+    {":MOT:SP?", "500", 0},
+    {":MOT:SP MIN", "", 0},
+    {":MOT:SP DEF", "", 0},
+    {":MOT:ACC", "", -109},
+    {":MOT:STR 10", "", 0},
+    {":MOT:STR?", "10", 0},
+    {":MOT:STR 0", "", 0},
+    {":MOT:STR?", "0", 0},
+  };
+
+  check(exchanges, sizeof(exchanges)/sizeof(exchanges[0]));
+}
+
+void test_scale_and_unit(){
+  static const struct exchange exchanges[] = {
+    {":MOT:SCAL?", "0", 0},
+    {":MOT:UNIT MM", "", -224},
+    {":MOT:SCAL 200,2MM", "", 0},
+    {":MOT:SCAL?", "200.00,2.000MM", 0},
+    {":MOT:UNIT MM", "", 0},
+    {":MOT:UNIT?", "MM", 0},
+    {":MOT:POS 1MM", "", 0},
+    {":MOT:POS?", "1.000", 0},
+    {":MOT:UNIT STEP", "", 0},
+    {":MOT:POS?", "100.00", 0},
+    {":MOT:SCAL DEF", "", 0},
+    {":MOT:SCAL?", "0", 0},
+  };
+
+  check(exchanges, sizeof(exchanges)/sizeof(exchanges[0]));
+}
+
+void test_driver(){
+  char expected[16];
+
+  snprintf(expected, sizeof(expected), "%s,%d", DRIVER_NAME, DRIVER_MICROSTEPS_MAX);
+  TEST_ASSERT_EQUAL_STRING(expected, query(":MOT:DRIV?"));
+}
+
+void test_trajectory(){
+  static const struct exchange exchanges[] = {
+    {":MOT:PVT:FREE?", "8", 0},
+    {":MOT:PVT 100,0,500", "", 0},
+    {":MOT:PVT:FREE?", "7", 0},
+    {":MOT:PVT:STATE?", "IDLE", 0},
+    {":MOT:PVT:STAR", "", 0},
+    {":MOT:PVT:STATE?", "RUNNING", 0},
+  };
+
+  check(exchanges, sizeof(exchanges)/sizeof(exchanges[0]));
+
+  run_trajectory(600);
+  TEST_ASSERT_EQUAL_STRING("IDLE", query(":MOT:PVT:STATE?"));
+  TEST_ASSERT_EQUAL_STRING("100.00", query(":MOT:POS?"));
+
+  query(":MOT:PVT 0,0,500");
+  query(":MOT:PVT:CLE");
+  TEST_ASSERT_EQUAL_STRING("8", query(":MOT:PVT:FREE?"));
+  TEST_ASSERT_EQUAL_INT(0, next_error());
+}
+
+void test_scan(){
+  static const struct exchange exchanges[] = {
+    {":MOT:SCAN:MODE RAST", "", 0},
+    {":MOT:SCAN:MODE?", "RAST", 0},
+    {":MOT:SCAN:MODE OSC", "", 0},
+    {":MOT:SCAN:MODE?", "OSC", 0},
+    {":MOT:SCAN:TRIG ON", "", 0},
+    {":MOT:SCAN:TRIG?", "1", 0},
+    {":MOT:SCAN:TRIG OFF", "", 0},
+    {":MOT:SCAN:TRIG?", "0", 0},
+    {":MOT:SCAN 0,10,2", "", 0},
+    {":MOT:SCAN:PROG?", "0,2,1", 0},
+  };
+
+  check(exchanges, sizeof(exchanges)/sizeof(exchanges[0]));
+
+  settle();
+  TEST_ASSERT_EQUAL_STRING("2,2,0", query(":MOT:SCAN:PROG?"));
+  TEST_ASSERT_EQUAL_STRING("0.00", query(":MOT:POS?"));
+}
+
+void test_list(){
+  static const struct exchange exchanges[] = {
+    {":MOT:LIST 5,10", "", 0},
+    {":MOT:LIST:COUN?", "2", 0},
+    {":MOT:LIST:EDGE FALL", "", 0},
+    {":MOT:LIST:EDGE?", "FALL", 0},
+    {":MOT:LIST:EDGE RIS", "", 0},
+    {":MOT:LIST:EDGE?", "RIS", 0},
+    {":MOT:LIST:STATE?", "IDLE", 0},
+    {":MOT:LIST:STAR", "", 0},
+    {":MOT:LIST:STATE?", "ARMED", 0},
+    {":MOT:LIST:IND?", "0", 0},
+  };
+
+  check(exchanges, sizeof(exchanges)/sizeof(exchanges[0]));
+
+  service();
+  INT1_vect();
+  settle();
+  TEST_ASSERT_EQUAL_STRING("5.00", query(":MOT:POS?"));
+  TEST_ASSERT_EQUAL_STRING("1", query(":MOT:LIST:IND?"));
+  TEST_ASSERT_EQUAL_STRING("0", query(":MOT:LIST:OVER?"));
+
+  query(":MOT:LIST:STOP");
+  TEST_ASSERT_EQUAL_STRING("IDLE", query(":MOT:LIST:STATE?"));
+  query(":MOT:LIST:CLE");
+  TEST_ASSERT_EQUAL_STRING("0", query(":MOT:LIST:COUN?"));
+  TEST_ASSERT_EQUAL_INT(0, next_error());
+}
+
+#ifdef PROFILE
+void test_profile(){
+  static const struct exchange exchanges[] = {
+    {"DIAG:PROF:RES", "", 0},
+    {"DIAG:PROF?", "STEP,0,0,0;CMD,0,0,0;FRAME,0,0,0;LOOP,0,0,0", 0},
+  };
+
+  check(exchanges, sizeof(exchanges)/sizeof(exchanges[0]));
+}
+#endif
+
+/*
+ * Header forms: long, short, any case, optional MOTor, paths of
+ * compound messages.
+ */
+void test_headers(){
+  static const struct exchange exchanges[] = {
+    {":MOTOR:POSITION?", "0.00", 0},
+    {":mot:pos?", "0.00", 0},
+    {":Motor:Pos?", "0.00", 0},
+    {":POS?", "0.00", 0},
+    {"POS?", "0.00", 0},
+    {":MOTO:POS?", "", -113},
+    {":MOT:LIM:POS 100;NEG -100", "", 0},
+    {":LIM:POS?;NEG?", "100.00;-100.00", 0},
+    {":LIM:POS?;:POS?", "100.00;0.00", 0},
+    {":", "", -113},
+  };
+
+  check(exchanges, sizeof(exchanges)/sizeof(exchanges[0]));
+}
+
+/*
+ * Every token is freed, and a message is refused without a trace when
+ * the heap runs out.
+ */
+void test_heap(){
+  query(":MOT:LIM:POS?;:MOT:SCAN:PROG?;*IDN?");
+  TEST_ASSERT_EQUAL_INT(mock_mallocs, mock_frees);
+
+  mock_malloc_budget = 1;
+  TEST_ASSERT_EQUAL_STRING("", query(":MOT:POS?"));
+  mock_malloc_budget = -1;
+  TEST_ASSERT_EQUAL_INT(-225, next_error());
+  TEST_ASSERT_EQUAL_INT(mock_mallocs, mock_frees);
+
+  mock_malloc_budget = 2;
+  query("SYST:MACR:DEF \"m\",\"MOV:REL 1\"");
+  mock_malloc_budget = -1;
+  TEST_ASSERT_TRUE(next_error() < 0);
+  TEST_ASSERT_EQUAL_INT(mock_mallocs, mock_frees);
+}
+
+int main(int argc, char** argv){
+  // both limit switches released
+  PIND = _BV(PD2) | _BV(PD4);
+  setup();
+  set_microstepping((microstep_t)DRIVER_MICROSTEPS_DEFAULT);
+  update_state();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_common_commands);
+  RUN_TEST(test_wait_for_motion);
+  RUN_TEST(test_error_queue);
+  RUN_TEST(test_communication);
+  RUN_TEST(test_events);
+  RUN_TEST(test_macros);
+  RUN_TEST(test_trace);
+  RUN_TEST(test_limits);
+  RUN_TEST(test_moves);
+  RUN_TEST(test_long_moves);
+  RUN_TEST(test_home_runs);
+  RUN_TEST(test_parameters);
+  RUN_TEST(test_scale_and_unit);
+  RUN_TEST(test_driver);
+  RUN_TEST(test_trajectory);
+  RUN_TEST(test_scan);
+  RUN_TEST(test_list);
+#ifdef PROFILE
+  RUN_TEST(test_profile);
+#endif
+  RUN_TEST(test_headers);
+  RUN_TEST(test_heap);
+  return UNITY_END();
+}